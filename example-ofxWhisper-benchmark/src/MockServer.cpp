@@ -0,0 +1,168 @@
+#include "MockServer.h"
+#include "Poco/Net/HTTPRequestHandler.h"
+#include "Poco/Net/HTTPRequestHandlerFactory.h"
+#include "Poco/Net/HTTPServerRequest.h"
+#include "Poco/Net/HTTPServerResponse.h"
+#include "Poco/Net/HTTPServerParams.h"
+#include "Poco/Net/ServerSocket.h"
+#include "Poco/Net/HTMLForm.h"
+#include "Poco/Net/PartHandler.h"
+#include "Poco/Net/MessageHeader.h"
+#include "Poco/StreamCopier.h"
+#include "Poco/Exception.h"
+#include "Poco/Timespan.h"
+
+namespace {
+    // Read the uploaded file and get the audio length from the wav header
+    class AudioPartHandler : public Poco::Net::PartHandler {
+    public:
+        void handlePart(const Poco::Net::MessageHeader & header, std::istream & stream) override {
+            string data;
+            Poco::StreamCopier::copyToString(stream, data);
+            size = data.size();
+            
+            // RIFF header. byte rate at 28, data after 44 bytes
+            if (data.size() > 44 && data.compare(0, 4, "RIFF") == 0) {
+                uint32_t byteRate;
+                memcpy(&byteRate, data.data() + 28, 4);
+                if (byteRate > 0) duration = (float)(data.size() - 44) / byteRate;
+            }
+        }
+        size_t size = 0;
+        float duration = -1;
+    };
+}
+
+class MockRequestHandler : public Poco::Net::HTTPRequestHandler {
+public:
+    MockRequestHandler(MockServer & server) : server(server) {}
+    
+    void handleRequest(Poco::Net::HTTPServerRequest & request, Poco::Net::HTTPServerResponse & response) override {
+        if (request.getMethod() != Poco::Net::HTTPRequest::HTTP_POST || request.getURI() != "/v1/audio/transcriptions") {
+            send(response, 404, "{\"error\":{\"type\":\"not_found\"}}");
+            return;
+        }
+        
+        AudioPartHandler audio;
+        Poco::Net::HTMLForm form(request, request.stream(), audio);
+        
+        auto & settings = server.settings;
+        float latency = settings.latency + settings.latencyPerAudioSec * MAX(0, audio.duration) + server.pickJitter();
+        int status = server.pickStatus();
+        
+        if (status == 408) {
+            // the server gave up waiting
+            ofSleepMillis(latency);
+            send(response, 408, "{\"error\":{\"type\":\"timeout\"}}");
+            return;
+        }
+        if (status == 429) {
+            response.set("Retry-After", ofToString(settings.retryAfter));
+            send(response, 429, "{\"error\":{\"type\":\"rate_limit_exceeded\"}}");
+            return;
+        }
+        ofSleepMillis(latency);
+        if (status == 500) {
+            send(response, 500, "{\"error\":{\"type\":\"server_error\"}}");
+            return;
+        }
+        
+        ofJson json;
+        json["text"] = "mock transcript " + ofToString(audio.duration, 2) + " sec";
+        json["language"] = form.has("language") ? form.get("language") : "english";
+        json["duration"] = audio.duration;
+        ofJson segment;
+        segment["start"] = 0;
+        segment["end"] = MAX(0, audio.duration);
+        segment["text"] = json["text"];
+        segment["avg_logprob"] = -0.2;
+        segment["no_speech_prob"] = 0.01;
+        json["segments"].push_back(segment);
+        
+        response.set("openai-processing-ms", ofToString((int)latency));
+        send(response, 200, json.dump());
+    }
+    
+private:
+    MockServer & server;
+    
+    void send(Poco::Net::HTTPServerResponse & response, int status, const string & body) {
+        server.countResponse(status);
+        response.setStatus((Poco::Net::HTTPResponse::HTTPStatus)status);
+        response.setContentType("application/json");
+        response.setContentLength(body.size());
+        response.setKeepAlive(true);
+        response.send() << body;
+    }
+};
+
+class MockRequestHandlerFactory : public Poco::Net::HTTPRequestHandlerFactory {
+public:
+    MockRequestHandlerFactory(MockServer & server) : server(server) {}
+    Poco::Net::HTTPRequestHandler * createRequestHandler(const Poco::Net::HTTPServerRequest &) override {
+        return new MockRequestHandler(server);
+    }
+private:
+    MockServer & server;
+};
+
+MockServer::~MockServer() {
+    stop();
+}
+
+bool MockServer::start(const Settings & _settings) {
+    stop();
+    settings = _settings;
+    try {
+        auto params = new Poco::Net::HTTPServerParams();
+        params->setMaxThreads(16);
+        params->setKeepAlive(true);
+        params->setKeepAliveTimeout(Poco::Timespan((Poco::Timespan::TimeDiff)(settings.keepAliveTimeout * Poco::Timespan::SECONDS)));
+        server.reset(new Poco::Net::HTTPServer(new MockRequestHandlerFactory(*this), Poco::Net::ServerSocket(settings.port), params));
+        server->start();
+    }
+    catch (Poco::Exception & e) {
+        ofLogError("MockServer") << "Cannot start: " << e.displayText();
+        server.reset();
+        return false;
+    }
+    ofLogNotice("MockServer") << "Listening on " << getEndpoint();
+    return true;
+}
+
+void MockServer::stop() {
+    if (server) {
+        server->stopAll(true);
+        server.reset();
+    }
+}
+
+string MockServer::getEndpoint() const {
+    return "http://127.0.0.1:" + ofToString(settings.port) + "/v1/audio/transcriptions";
+}
+
+map<int, int> MockServer::getResponseCounts() {
+    std::lock_guard<ofMutex> lock(mutex);
+    return responseCounts;
+}
+
+int MockServer::pickStatus() {
+    std::lock_guard<ofMutex> lock(mutex);
+    float r = std::uniform_real_distribution<float>(0, 1)(random);
+    if (r < settings.p429) return 429;
+    r -= settings.p429;
+    if (r < settings.p500) return 500;
+    r -= settings.p500;
+    if (r < settings.p408) return 408;
+    return 200;
+}
+
+float MockServer::pickJitter() {
+    std::lock_guard<ofMutex> lock(mutex);
+    return std::uniform_real_distribution<float>(0, settings.jitter)(random);
+}
+
+void MockServer::countResponse(int status) {
+    std::lock_guard<ofMutex> lock(mutex);
+    responseCounts[status]++;
+}
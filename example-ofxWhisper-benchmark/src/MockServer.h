@@ -0,0 +1,50 @@
+#pragma once
+
+#include "ofMain.h"
+#include "Poco/Net/HTTPServer.h"
+#include <random>
+
+// Local stand-in for https://api.openai.com/v1/audio/transcriptions
+// Returns verbose_json after the configured latency, or an injected error.
+class MockServer {
+public:
+    struct Settings {
+        int port = 8089;
+        // latency = base + perAudioSec * audio length + uniform(0, jitter) (ms)
+        float latency = 300;
+        float latencyPerAudioSec = 20;
+        float jitter = 100;
+        // probability of errors (0-1)
+        float p429 = 0;
+        float p500 = 0;
+        float p408 = 0;
+        // Retry-After of 429 (sec)
+        float retryAfter = 1;
+        // idle keep-alive connections are closed after this time (sec)
+        float keepAliveTimeout = 10;
+    };
+    
+    ~MockServer();
+    
+    bool start(const Settings & settings);
+    void stop();
+    
+    string getEndpoint() const;
+    
+    // Response counts by status
+    map<int, int> getResponseCounts();
+    
+private:
+    Settings settings;
+    unique_ptr<Poco::Net::HTTPServer> server;
+    
+    friend class MockRequestHandler;
+    ofMutex mutex;
+    std::mt19937 random{1234};
+    map<int, int> responseCounts;
+    
+    // decide the response status (thread safe)
+    int pickStatus();
+    float pickJitter();
+    void countResponse(int status);
+};
@@ -0,0 +1,12 @@
+#include "ofMain.h"
+#include "ofAppNoWindow.h"
+#include "ofApp.h"
+
+//========================================================================
+// Headless. e.g.
+// ./example-ofxWhisper-benchmark --wav-dir wav --speed 10 --latency 300 --p429 0.05 --p500 0.05 --p408 0.02
+int main(int argc, char * argv[]){
+	ofAppNoWindow window;
+	ofSetupOpenGL(&window, 1024, 768, OF_WINDOW);
+	ofRunApp(new ofApp(vector<string>(argv + 1, argv + argc)));
+}
@@ -0,0 +1,302 @@
+#include "ofApp.h"
+#include "ofxWhisperOpenAIBackend.h"
+#include "ofxWhisperResampler.h"
+#include "ofxAudioFile.h"
+
+//--------------------------------------------------------------
+ofApp::ofApp(vector<string> args) {
+    parseArgs(args);
+}
+
+//--------------------------------------------------------------
+void ofApp::parseArgs(const vector<string> & args) {
+    for (size_t i = 0; i + 1 < args.size(); i += 2) {
+        const string & key = args[i];
+        const string & value = args[i + 1];
+        if (key == "--wav-dir") wavDir = value;
+        else if (key == "--utterances") numUtterances = ofToInt(value);
+        else if (key == "--speed") speed = MAX(0.1, ofToFloat(value));
+        else if (key == "--gap") gapTime = ofToFloat(value);
+        else if (key == "--silence") silenceTime = ofToFloat(value);
+        else if (key == "--workers") numWorkers = ofToInt(value);
+        else if (key == "--wait") waitTime = ofToFloat(value);
+        else if (key == "--report") reportPath = value;
+        else if (key == "--port") serverSettings.port = ofToInt(value);
+        else if (key == "--latency") serverSettings.latency = ofToFloat(value);
+        else if (key == "--latency-per-sec") serverSettings.latencyPerAudioSec = ofToFloat(value);
+        else if (key == "--jitter") serverSettings.jitter = ofToFloat(value);
+        else if (key == "--p429") serverSettings.p429 = ofToFloat(value);
+        else if (key == "--p500") serverSettings.p500 = ofToFloat(value);
+        else if (key == "--p408") serverSettings.p408 = ofToFloat(value);
+        else ofLogWarning("benchmark") << "Unknown option " << key;
+    }
+}
+
+//--------------------------------------------------------------
+void ofApp::setup(){
+    ofSetLogLevel(OF_LOG_NOTICE);
+    ofSetLogLevel("ofxWhisper", OF_LOG_WARNING);
+    
+    if (wavDir != "") {
+        loadWavs();
+    } else {
+        synthesize();
+    }
+    if (truth.empty()) {
+        ofLogError("benchmark") << "No audio. Exit.";
+        ofExit(1);
+        return;
+    }
+    ofLogNotice("benchmark") << truth.size() << " utterances, " << timeline.size() / sampleRate << " sec, speed x" << speed;
+    
+    if (!server.start(serverSettings)) {
+        ofExit(1);
+        return;
+    }
+    
+    // OpenAI backend against the mock server
+    auto backend = make_shared<ofxWhisperOpenAIBackend>("mock");
+    backend->setEndpoint(server.getEndpoint());
+    whisper.setup(backend);
+    whisper.setNumWorkers(numWorkers);
+    whisper.setInMemoryRecording(true);
+    whisper.setRrSilenceTimeMax(silenceTime);
+    whisper.setupCapture(sampleRate, 1, bufferSize);
+    
+    ofAddListener(whisper.audioEvents, this, &ofApp::audioLevel);
+    ofAddListener(whisper.transcriptEvents, this, &ofApp::transcriptReady);
+    
+    whisper.startRealtimeRecording();
+    startTime = ofGetElapsedTimeMillis();
+    feeder.startThread();
+}
+
+//--------------------------------------------------------------
+void ofApp::update(){
+    if (startTime == 0 || !feedDone) return;
+    if (feedEndTime == 0) feedEndTime = ofGetElapsedTimeMillis();
+    
+    // wait for all segments (or timeout)
+    detectedMutex.lock();
+    size_t numDetected = detected.size();
+    detectedMutex.unlock();
+    resultMutex.lock();
+    size_t numResults = results.size();
+    resultMutex.unlock();
+    
+    bool finished = numResults + whisper.getNumDropped() >= numDetected;
+    if (finished || ofGetElapsedTimeMillis() - feedEndTime > waitTime * 1000) {
+        if (!finished) ofLogWarning("benchmark") << "Timeout. " << numResults << "/" << numDetected << " transcripts";
+        report();
+        ofExit(0);
+    }
+}
+
+//--------------------------------------------------------------
+void ofApp::exit(){
+    feeder.waitForThread(true);
+    whisper.stopRealtimeRecording();
+    ofRemoveListener(whisper.audioEvents, this, &ofApp::audioLevel);
+    ofRemoveListener(whisper.transcriptEvents, this, &ofApp::transcriptReady);
+    server.stop();
+}
+
+//--------------------------------------------------------------
+void ofApp::audioLevel(ofxWhisper::AudioEventArgs & args) {
+    // segment boundaries in the audio time
+    float time = (float)numBlocks * bufferSize / sampleRate;
+    numBlocks++;
+    if (args.isRecording == wasRecording) return;
+    wasRecording = args.isRecording;
+    
+    detectedMutex.lock();
+    if (args.isRecording) {
+        detected.push_back({time, -1});
+    } else if (!detected.empty()) {
+        detected.back().second = time;
+    }
+    detectedMutex.unlock();
+}
+
+//--------------------------------------------------------------
+void ofApp::transcriptReady(ofxWhisper::TranscriptResult & result) {
+    resultMutex.lock();
+    results.push_back(result);
+    lastResultTime = ofGetElapsedTimeMillis();
+    resultMutex.unlock();
+}
+
+//--------------------------------------------------------------
+void ofApp::Feeder::threadedFunction() {
+    ofSoundBuffer block;
+    block.allocate(app.bufferSize, 1);
+    block.setSampleRate(app.sampleRate);
+    
+    // faster than realtime, but paced so the capture ring buffer does not overflow
+    auto start = std::chrono::steady_clock::now();
+    double blockTime = (double)app.bufferSize / app.sampleRate / app.speed;
+    size_t numBlocks = app.timeline.size() / app.bufferSize;
+    for (size_t i = 0; i < numBlocks && isThreadRunning(); ++i) {
+        memcpy(block.getBuffer().data(), app.timeline.data() + i * app.bufferSize, app.bufferSize * sizeof(float));
+        app.whisper.audioIn(block);
+        std::this_thread::sleep_until(start + std::chrono::duration<double>(blockTime * (i + 1)));
+    }
+    app.feedDone = true;
+}
+
+//--------------------------------------------------------------
+void ofApp::addSilence(float sec) {
+    // low noise
+    size_t numSamples = sec * sampleRate;
+    for (size_t i = 0; i < numSamples; ++i) {
+        timeline.push_back(ofRandom(-0.002, 0.002));
+    }
+}
+
+//--------------------------------------------------------------
+void ofApp::addUtterance(const vector<float> & pcm) {
+    addSilence(gapTime);
+    float start = (float)timeline.size() / sampleRate;
+    timeline.insert(timeline.end(), pcm.begin(), pcm.end());
+    truth.push_back({start, (float)timeline.size() / sampleRate});
+}
+
+//--------------------------------------------------------------
+void ofApp::loadWavs() {
+    // each file is one utterance
+    ofDirectory dir(wavDir);
+    dir.allowExt("wav");
+    dir.listDir();
+    dir.sort();
+    for (size_t i = 0; i < dir.size(); ++i) {
+        ofxAudioFile audioFile;
+        audioFile.load(dir.getPath(i));
+        if (!audioFile.loaded()) continue;
+        vector<float> pcm;
+        ofxWhisperResampler::toMono(audioFile.data(), audioFile.length(), audioFile.channels(), audioFile.samplerate(), sampleRate, pcm);
+        addUtterance(pcm);
+    }
+    addSilence(gapTime + silenceTime);
+}
+
+//--------------------------------------------------------------
+void ofApp::synthesize() {
+    // voiced sound (harmonics of 100-250Hz) with 4Hz syllable envelope, 1-5 sec
+    ofSeedRandom(1234);
+    for (int n = 0; n < numUtterances; ++n) {
+        vector<float> pcm(ofRandom(1, 5) * sampleRate);
+        float f0 = ofRandom(100, 250);
+        for (size_t i = 0; i < pcm.size(); ++i) {
+            float t = (float)i / sampleRate;
+            float v = 0;
+            for (int h = 1; h <= 8; ++h) {
+                v += sin(TWO_PI * f0 * h * t) / h;
+            }
+            float envelope = 0.6 + 0.4 * sin(TWO_PI * 4 * t);
+            pcm[i] = 0.2 * v * envelope;
+        }
+        addUtterance(pcm);
+    }
+    // trailing silence closes the last utterance
+    addSilence(gapTime + silenceTime);
+}
+
+//--------------------------------------------------------------
+void ofApp::report() {
+    float wallTime = ((lastResultTime > 0 ? lastResultTime : ofGetElapsedTimeMillis()) - startTime) / 1000.;
+    float audioTime = (float)timeline.size() / sampleRate;
+    
+    // segmentation. truth and detection are matched by overlap
+    detectedMutex.lock();
+    auto segments = detected;
+    detectedMutex.unlock();
+    if (!segments.empty() && segments.back().second < 0) segments.back().second = audioTime;
+    
+    auto overlaps = [](const pair<float, float> & a, const pair<float, float> & b) {
+        return a.first < b.second && b.first < a.second;
+    };
+    int matched = 0, missed = 0, split = 0, merged = 0, falseAlarms = 0;
+    float onsetDelay = 0, offsetDelay = 0;
+    for (auto & t : truth) {
+        int n = 0;
+        const pair<float, float> * match = nullptr;
+        for (auto & d : segments) {
+            if (overlaps(t, d)) {
+                n++;
+                match = &d;
+            }
+        }
+        if (n == 0) {
+            missed++;
+        } else if (n > 1) {
+            split++;
+        } else {
+            int m = 0;
+            for (auto & t2 : truth) {
+                if (overlaps(t2, *match)) m++;
+            }
+            if (m == 1) {
+                matched++;
+                onsetDelay += match->first - t.first;
+                offsetDelay += match->second - t.second;
+            }
+        }
+    }
+    for (auto & d : segments) {
+        int m = 0;
+        for (auto & t : truth) {
+            if (overlaps(t, d)) m++;
+        }
+        if (m == 0) falseAlarms++;
+        if (m > 1) merged++;
+    }
+    
+    resultMutex.lock();
+    size_t numResults = results.size();
+    resultMutex.unlock();
+    
+    auto stats = whisper.getStats();
+    auto & latency = stats.histograms["latency_ms"];
+    auto & request = stats.histograms["request_ms"];
+    
+    ofJson json;
+    json["audio_sec"] = audioTime;
+    json["wall_sec"] = wallTime;
+    json["speed"] = speed;
+    json["segmentation"]["truth"] = truth.size();
+    json["segmentation"]["detected"] = segments.size();
+    json["segmentation"]["matched"] = matched;
+    json["segmentation"]["missed"] = missed;
+    json["segmentation"]["split"] = split;
+    json["segmentation"]["merged"] = merged;
+    json["segmentation"]["false_alarms"] = falseAlarms;
+    if (truth.empty()) {
+        // e.g. silent input
+        ofLogWarning("benchmark") << "No ground truth segments. Segmentation accuracy is not reported.";
+        json["segmentation"]["accuracy"] = nullptr;
+    } else {
+        json["segmentation"]["accuracy"] = (float)matched / truth.size();
+    }
+    json["segmentation"]["onset_delay_sec"] = matched > 0 ? onsetDelay / matched : 0;
+    json["segmentation"]["offset_delay_sec"] = matched > 0 ? offsetDelay / matched : 0;
+    json["transcripts"] = numResults;
+    json["retried"] = whisper.getNumRetried();
+    json["dropped"] = whisper.getNumDropped();
+    for (auto & c : server.getResponseCounts()) {
+        json["server_responses"][ofToString(c.first)] = c.second;
+    }
+    json["latency_ms"] = {{"p50", latency.p50}, {"p90", latency.p90}, {"p99", latency.p99}, {"max", latency.max}};
+    json["request_ms"] = {{"p50", request.p50}, {"p90", request.p90}, {"p99", request.p99}, {"max", request.max}};
+    json["throughput"]["audio_sec_per_sec"] = wallTime > 0 ? audioTime / wallTime : 0;
+    json["throughput"]["transcripts_per_sec"] = wallTime > 0 ? numResults / wallTime : 0;
+    json["stats"] = stats.toJson();
+    
+    ofLogNotice("benchmark") << "segmentation: " << matched << "/" << truth.size() << " matched, "
+        << missed << " missed, " << split << " split, " << merged << " merged, " << falseAlarms << " false";
+    ofLogNotice("benchmark") << "latency p50:" << latency.p50 << " p90:" << latency.p90 << " p99:" << latency.p99 << " ms";
+    ofLogNotice("benchmark") << "throughput: " << audioTime / MAX(0.001, wallTime) << " audio sec/sec, "
+        << whisper.getNumRetried() << " retried, " << whisper.getNumDropped() << " dropped";
+    
+    ofSavePrettyJson(reportPath, json);
+    ofLogNotice("benchmark") << "Report: " << ofToDataPath(reportPath, true);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxWhisper.h"
+#include "MockServer.h"
+
+// Headless benchmark. Audio (wav files or synthetic utterances) is fed to audioIn()
+// faster than realtime and transcribed by a local mock server.
+// Segmentation accuracy, latency and throughput are reported.
+class ofApp : public ofBaseApp {
+public:
+    ofApp(vector<string> args);
+    
+    void setup();
+    void update();
+    void exit();
+    
+    void audioLevel(ofxWhisper::AudioEventArgs & args);
+    void transcriptReady(ofxWhisper::TranscriptResult & result);
+    
+private:
+    // options (see parseArgs())
+    string wavDir;
+    int numUtterances = 20;
+    float speed = 10;
+    float gapTime = 2.0;
+    float silenceTime = 0.8;
+    int numWorkers = 4;
+    float waitTime = 60;
+    string reportPath = "benchmark.json";
+    MockServer::Settings serverSettings;
+    void parseArgs(const vector<string> & args);
+    
+    ofxWhisper whisper;
+    MockServer server;
+    
+    // audio timeline (16kHz mono) and true utterances (sec)
+    const int sampleRate = 16000, bufferSize = 256;
+    vector<float> timeline;
+    vector<pair<float, float>> truth;
+    void loadWavs();
+    void synthesize();
+    void addUtterance(const vector<float> & pcm);
+    void addSilence(float sec);
+    
+    // detected segments (sec). capture thread
+    ofMutex detectedMutex;
+    vector<pair<float, float>> detected;
+    uint64_t numBlocks = 0;
+    bool wasRecording = false;
+    
+    // feed timeline to audioIn() at speed
+    class Feeder : public ofThread {
+    public:
+        Feeder(ofApp & app) : app(app) {}
+        void threadedFunction() override;
+    private:
+        ofApp & app;
+    };
+    Feeder feeder{*this};
+    std::atomic<bool> feedDone{false};
+    
+    ofMutex resultMutex;
+    vector<ofxWhisper::TranscriptResult> results;
+    uint64_t startTime = 0, feedEndTime = 0, lastResultTime = 0;
+    
+    void report();
+};
@@ -0,0 +1,12 @@
+#include "ofMain.h"
+#include "ofAppNoWindow.h"
+#include "ofApp.h"
+
+//========================================================================
+// Headless. e.g.
+// ./example-ofxWhisper-dspBenchmark --frames 256 --channels 1,2,8 --seconds 60
+int main(int argc, char * argv[]){
+	ofAppNoWindow window;
+	ofSetupOpenGL(&window, 1024, 768, OF_WINDOW);
+	ofRunApp(new ofApp(vector<string>(argv + 1, argv + argc)));
+}
@@ -0,0 +1,100 @@
+#include "ofApp.h"
+
+//--------------------------------------------------------------
+ofApp::ofApp(vector<string> args) {
+    parseArgs(args);
+}
+
+//--------------------------------------------------------------
+void ofApp::parseArgs(const vector<string> & args) {
+    for (size_t i = 0; i + 1 < args.size(); i += 2) {
+        const string & key = args[i];
+        const string & value = args[i + 1];
+        if (key == "--frames") numFrames = MAX(1, ofToInt(value));
+        else if (key == "--channels") {
+            channels.clear();
+            for (auto & c : ofSplitString(value, ",", true, true)) {
+                channels.push_back(MAX(1, ofToInt(c)));
+            }
+        }
+        else if (key == "--rate") sampleRate = MAX(1, ofToInt(value));
+        else if (key == "--seconds") seconds = MAX(0.1, ofToFloat(value));
+        else if (key == "--report") reportPath = value;
+        else ofLogWarning("dspBenchmark") << "Unknown option " << key;
+    }
+}
+
+//--------------------------------------------------------------
+void ofApp::setup(){
+    ofSetLogLevel(OF_LOG_NOTICE);
+    bool simdEnabled = ofxWhisperDsp::isSimdEnabled();
+    ofxWhisperDsp::setSimdEnabled(true);
+    string implementation = ofxWhisperDsp::getImplementation();
+    ofLogNotice("dspBenchmark") << implementation << ", " << numFrames << " frames per block, " << seconds << " sec of audio per run";
+
+    ofJson json;
+    json["implementation"] = implementation;
+    json["frames"] = numFrames;
+    json["sample_rate"] = sampleRate;
+
+    for (int numChannels : channels) {
+        // speech-like test signal: tone + noise + DC offset
+        size_t numSamples = numFrames * numChannels;
+        vector<float> block(numSamples), work(numSamples), mono(numFrames), dc(numChannels, 0);
+        vector<int16_t> pcm(numSamples);
+        for (size_t i = 0; i < numSamples; ++i) {
+            size_t frame = i / numChannels;
+            block[i] = 0.5 * sin(TWO_PI * 220 * frame / sampleRate) + ofRandom(-0.1, 0.1) + 0.02;
+        }
+
+        // the results go to sink, so the kernels are not optimized away
+        volatile float sink = 0;
+        vector<pair<string, function<void()>>> kernels = {
+            {"peak", [&] { sink = ofxWhisperDsp::peak(block.data(), numSamples); }},
+            {"rms", [&] { sink = ofxWhisperDsp::rms(block.data(), numSamples); }},
+            {"downmix", [&] { ofxWhisperDsp::downmix(block.data(), numFrames, numChannels, mono.data()); sink = mono[0]; }},
+            {"int16", [&] { ofxWhisperDsp::toInt16(block.data(), numSamples, pcm.data()); sink = pcm[0]; }},
+            {"dc", [&] {
+                // in place. restore the block for the next run.
+                memcpy(work.data(), block.data(), numSamples * sizeof(float));
+                ofxWhisperDsp::removeDc(work.data(), numFrames, numChannels, dc.data(), 0.005);
+                sink = work[0];
+            }},
+        };
+
+        for (auto & kernel : kernels) {
+            ofxWhisperDsp::setSimdEnabled(false);
+            double scalar = measure(kernel.second, numSamples);
+            ofxWhisperDsp::setSimdEnabled(true);
+            double simd = measure(kernel.second, numSamples);
+            double speedup = simd > 0 ? scalar / simd : 0;
+
+            ofLogNotice("dspBenchmark") << numChannels << "ch " << kernel.first << ": scalar " << scalar << " ns, "
+                << implementation << " " << simd << " ns per sample (x" << speedup << ")";
+            auto & result = json["channels"][ofToString(numChannels)][kernel.first];
+            result["scalar_ns_per_sample"] = scalar;
+            result["simd_ns_per_sample"] = simd;
+            result["speedup"] = speedup;
+            // share of one core for realtime capture of this channel count
+            result["realtime_load"] = simd * 1e-9 * sampleRate * numChannels;
+        }
+    }
+    ofxWhisperDsp::setSimdEnabled(simdEnabled);
+
+    ofSavePrettyJson(reportPath, json);
+    ofLogNotice("dspBenchmark") << "Report: " << ofToDataPath(reportPath, true);
+    ofExit(0);
+}
+
+//--------------------------------------------------------------
+double ofApp::measure(const function<void()> & kernel, size_t numSamples) {
+    size_t numBlocks = MAX(1, seconds * sampleRate / numFrames);
+
+    // warm up caches and clocks
+    for (size_t i = 0; i < MIN(numBlocks, (size_t)1000); ++i) kernel();
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < numBlocks; ++i) kernel();
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / (numBlocks * numSamples);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxWhisperDsp.h"
+
+// Micro-benchmark of the capture path kernels (ofxWhisperDsp).
+// Each kernel runs on blocks of captured audio with the vectorized and the scalar versions.
+class ofApp : public ofBaseApp {
+public:
+    ofApp(vector<string> args);
+
+    void setup();
+
+private:
+    // options (see parseArgs())
+    int numFrames = 256;
+    vector<int> channels = {1, 2, 8};
+    int sampleRate = 48000;
+    // audio processed by each run (sec)
+    float seconds = 60;
+    string reportPath = "dsp_benchmark.json";
+    void parseArgs(const vector<string> & args);
+
+    // Nanoseconds per sample of a kernel with the current implementation
+    double measure(const function<void()> & kernel, size_t numSamples);
+};
@@ -0,0 +1,69 @@
+#include "ofApp.h"
+#include "ofxWhisperLocalBackend.h"
+
+void ofApp::setup() {
+    ofSetLogLevel(OF_LOG_VERBOSE);
+    ofSetWindowTitle("example-ofxWhisper-local");
+
+    // Offline transcription with whisper.cpp. No api key needed.
+    // Download a model (e.g. ggml-tiny.en.bin) into bin/data.
+    // https://huggingface.co/ggerganov/whisper.cpp
+    whisper.setup(make_shared<ofxWhisperLocalBackend>("ggml-tiny.en.bin"));
+    whisper.setupRecorder(0);
+    whisper.setInMemoryRecording(true);
+    
+    // show partial transcripts while recording
+    whisper.setStreaming(true, 0.5);
+    ofAddListener(whisper.partialTranscriptEvents, this, &ofApp::partialTranscript);
+}
+
+void ofApp::update() {
+    if (whisper.hasTranscript()) {
+        transcripts.push_back(whisper.getNextTranscript());
+    }
+}
+
+void ofApp::draw() {
+    if (whisper.isRecording()) {
+        ofSetColor(255, 0, 0);
+        ofDrawBitmapString("Recording. Space key to stop.", 20, 40);
+    } else {
+        ofSetColor(0, 220, 0);
+        ofDrawBitmapString("Space key to record your voice, or drag and drop audio file here.", 20, 40);
+    }
+    
+    captionMutex.lock();
+    ofSetColor(255, 255, 0);
+    ofDrawBitmapString(caption, 20, 60);
+    captionMutex.unlock();
+    
+    int y = 80;
+    for (auto text : transcripts) {
+        ofSetColor(200);
+        ofDrawBitmapString(text, 20, y);
+        y+=16;
+    }
+}
+
+void ofApp::keyPressed(int key) {
+    if (key == ' ') {
+        if (whisper.isRecording()) {
+            whisper.stopRecording();
+        } else {
+            whisper.startRecording();
+        }
+    }
+}
+
+void ofApp::dragEvent(ofDragInfo dragInfo) {
+    for (auto file : dragInfo.files) {
+        whisper.transcript(file);
+    }
+}
+
+void ofApp::partialTranscript(ofxWhisper::PartialTranscriptEventArgs & args) {
+    // called from the streaming thread
+    captionMutex.lock();
+    caption = args.isFinal ? "" : args.committed + " " + args.provisional;
+    captionMutex.unlock();
+}
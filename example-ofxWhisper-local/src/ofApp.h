@@ -0,0 +1,21 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxWhisper.h"
+
+class ofApp : public ofBaseApp {
+public:
+    void setup();
+    void update();
+    void draw();
+    void keyPressed(int key);
+    void dragEvent(ofDragInfo dragInfo);
+    void partialTranscript(ofxWhisper::PartialTranscriptEventArgs & args);
+
+    ofxWhisper whisper;
+    vector<string> transcripts;
+    
+    // live caption while speaking
+    string caption;
+    ofMutex captionMutex;
+};
@@ -27,6 +27,12 @@ void ofApp::setup(){
     whisper.setRrEndThreshold(0.02);
     whisper.setRrSilenceTimeMax(2.0);
     
+    // detect speech with VAD instead of the peak level
+    //whisper.setVad(make_shared<ofxWhisperEnergyVad>());
+    
+    // upload short utterances concurrently
+    whisper.setNumWorkers(3);
+    
     // set language
     //whisper.setLanguage("ja");
     
@@ -1,304 +1,2328 @@
 #include "ofxWhisper.h"
+#include "ofxWhisperBatch.h"
+#include "ofxWhisperJournal.h"
+#include "ofxWhisperOpenAIBackend.h"
+#include "ofxWhisperResampler.h"
+#include "ofxAudioFile.h"
 
-ofxWhisper::ofxWhisper() : recording(false), realtimeRecording(false), audioLevel(0) {
+ofxWhisper::ofxWhisper() : realtimeRecording(false) {
+    sources.reserve(maxSources);
     setRrStartThreshold(0.05);
     setRrEndThreshold(0.03);
     setRrSilenceTimeMax(1.0);
+    
+    // source 0 is set up by setupRecorder() / setupCapture()
+    addSource("");
+}
+
+ofxWhisper::~ofxWhisper() {
+    stream.close();
+    for (auto & device : deviceInputs) {
+        device->stream.close();
+    }
+    captureWorker.waitForThread(true);
+    streamingWorker.waitForThread(true);
+    journalWorker.stopThread();
+    journalCondition.notify_all();
+    journalWorker.waitForThread(false);
+    stopThread();
+    for (auto & worker : uploadWorkers) {
+        worker->stopThread();
+    }
+    audioQueCondition.notify_all();
+    waitForThread();
+    for (auto & worker : uploadWorkers) {
+        worker->waitForThread();
+    }
+    completionWorker.stopThread();
+    completionCondition.notify_all();
+    completionWorker.waitForThread(false);
+    
+    // delete wav files
+    segmentStore.clear();
+    
+    // transcript() requests which are not sent any more
+    updateListener.unsubscribe();
+    for (auto & c : completions) {
+        TranscriptResult result;
+        result.id = c.first;
+        result.errorCode = Cancelled;
+        c.second->promise.set_value(result);
+    }
+}
+
+void ofxWhisper::setup(string api_key) {
+    setup(make_shared<ofxWhisperOpenAIBackend>(api_key));
+}
+
+void ofxWhisper::setup(shared_ptr<ofxWhisperBackend> _backend) {
+    backend = _backend;
+    if (!backend || !backend->setup()) {
+        ofLogError("ofxWhisper") << "Backend setup failed";
+    } else {
+        ofLogNotice("ofxWhisper") << "Backend: " << backend->getName();
+    }
+}
+
+void ofxWhisper::printSoundDevices() {
+    return ofxSoundUtils::printInputSoundDevices();
+}
+
+vector<ofSoundDevice> ofxWhisper::getSoundDevices() {
+    return ofxSoundUtils::getInputSoundDevices();
+}
+
+void ofxWhisper::setupRecorder(int _soundDeviceID) {
+    auto inDevices = ofxSoundUtils::getInputSoundDevices();
+    
+    size_t inDeviceIndex = _soundDeviceID;
+    
+    // Setup the sound stream.
+    ofSoundStreamSettings settings;
+    settings.bufferSize = 256;
+    settings.numBuffers = 1;
+    settings.numInputChannels = MIN(2, inDevices[inDeviceIndex].inputChannels);
+    settings.numOutputChannels = MIN(2, inDevices[inDeviceIndex].outputChannels);
+    settings.sampleRate = inDevices[inDeviceIndex].sampleRates[0];
+    settings.setInDevice(inDevices[inDeviceIndex]);
+    settings.setInListener(this);
+    
+    setupCapture(settings.sampleRate, settings.numInputChannels, settings.bufferSize);
+    stream.setup(settings);
+}
+
+void ofxWhisper::setupCapture(int sampleRate, int numChannels, int bufferSize) {
+    captureWorker.waitForThread(true);
+    configureSource(*sources[0], sampleRate, numChannels, bufferSize);
+    captureWorker.startThread();
+}
+
+int ofxWhisper::addDeviceSource(int soundDeviceID, int channel, string name) {
+    auto inDevices = ofxSoundUtils::getInputSoundDevices();
+    if (soundDeviceID < 0 || soundDeviceID >= (int)inDevices.size()) {
+        ofLogError("ofxWhisper") << "No sound device " << soundDeviceID;
+        return -1;
+    }
+    auto & device = inDevices[soundDeviceID];
+    if (channel >= (int)device.inputChannels) {
+        ofLogError("ofxWhisper") << device.name << " has no channel " << channel;
+        return -1;
+    }
+    
+    // sources of the same device share the stream
+    DeviceInput * input = nullptr;
+    for (auto & d : deviceInputs) {
+        if (d->deviceID == soundDeviceID) input = d.get();
+    }
+    if (!input) {
+        deviceInputs.emplace_back(new DeviceInput(*this));
+        input = deviceInputs.back().get();
+        input->deviceID = soundDeviceID;
+        input->numChannels = device.inputChannels;
+    }
+    
+    ofSoundStreamSettings settings;
+    settings.bufferSize = 256;
+    settings.numBuffers = 1;
+    settings.numInputChannels = input->numChannels;
+    settings.numOutputChannels = 0;
+    settings.sampleRate = device.sampleRates[0];
+    settings.setInDevice(device);
+    settings.setInListener(input);
+    
+    if (name == "") {
+        name = device.name + (channel >= 0 ? " ch" + ofToString(channel) : "");
+    }
+    int sourceId = addCaptureSource(settings.sampleRate, channel >= 0 ? 1 : input->numChannels, settings.bufferSize, name);
+    if (sourceId < 0) return -1;
+    
+    // restart the stream with the new route
+    input->stream.close();
+    input->routes.push_back({sourceId, channel});
+    input->stream.setup(settings);
+    return sourceId;
+}
+
+int ofxWhisper::addCaptureSource(int sampleRate, int numChannels, int bufferSize, string name) {
+    captureWorker.waitForThread(true);
+    
+    // source 0 is used first if it is not set up yet
+    CaptureSource * source = sources[0]->configured ? nullptr : sources[0].get();
+    if (!source) {
+        if (numSources >= maxSources) {
+            ofLogError("ofxWhisper") << "Too many sources";
+            captureWorker.startThread();
+            return -1;
+        }
+        source = &addSource(name);
+    }
+    source->name = name;
+    configureSource(*source, sampleRate, numChannels, bufferSize);
+    
+    captureWorker.startThread();
+    ofLogNotice("ofxWhisper") << "Source " << source->id << ": " << name;
+    return source->id;
+}
+
+ofxWhisper::CaptureSource & ofxWhisper::addSource(string name) {
+    std::lock_guard<ofMutex> lock(sourcesMutex);
+    sources.emplace_back(new CaptureSource());
+    auto & source = *sources.back();
+    source.id = sources.size() - 1;
+    source.name = name;
+    source.rrStartThreshold = rrStartThreshold;
+    source.rrEndThreshold = rrEndThreshold;
+    numSources = sources.size();
+    return source;
+}
+
+void ofxWhisper::configureSource(CaptureSource & source, int sampleRate, int numChannels, int bufferSize) {
+    // the audio thread may be running. stop writing to the ring before it is reallocated.
+    source.configured = false;
+    while (source.writers > 0) std::this_thread::yield();
+    
+    source.sampleRate = sampleRate;
+    source.numChannels = MAX(1, numChannels);
+    source.bufferSize = MAX(1, bufferSize);
+    
+    // 2 sec of audio between audioIn() and processCapture()
+    source.ring.allocate(source.sampleRate * source.numChannels * 2);
+    source.droppedSamples = 0;
+    
+    allocatePreRoll(source);
+    source.postRollRemaining = 0;
+    
+    source.audioPool.allocate(audioPoolSize, source.bufferSize, source.numChannels, source.sampleRate);
+    source.capturedFrames = 0;
+    source.dcOffsets.assign(source.numChannels, 0);
+    
+    // silence count depends on the buffer size
+    source.rrSilenceCoutMax = rrSilenceTimeMax * source.sampleRate / source.bufferSize;
+    
+    // we register the recorder end event
+    int sourceId = source.id;
+    source.recordingEndListener = source.recorder.recordingEndEvent.newListener([this, sourceId](string & filePath) {
+        recordingEndCallback(sourceId, filePath);
+    });
+    source.configured = true;
+}
+
+void ofxWhisper::allocatePreRoll(CaptureSource & source) {
+    size_t numFrames = preRollTime * source.sampleRate / 1000;
+    source.preRoll.allocate(numFrames * source.numChannels);
+    source.preRollBlock.allocate(numFrames, source.numChannels);
+    source.preRollBlock.setSampleRate(source.sampleRate);
+}
+
+int ofxWhisper::getNumSources() const {
+    return numSources;
+}
+
+string ofxWhisper::getSourceName(int sourceId) {
+    auto source = getSource(sourceId);
+    return source ? source->name : "";
+}
+
+int ofxWhisper::subscribeAudio(AudioBlockCallback callback, int sourceId) {
+    std::lock_guard<ofMutex> lock(audioSubscriptionMutex);
+    auto subscriptions = audioSubscriptions ? make_shared<vector<AudioSubscription>>(*audioSubscriptions) : make_shared<vector<AudioSubscription>>();
+    int id = nextSubscriptionId++;
+    subscriptions->push_back(AudioSubscription{id, sourceId, callback});
+    audioSubscriptions = subscriptions;
+    numAudioSubscriptions = subscriptions->size();
+    return id;
+}
+
+void ofxWhisper::unsubscribeAudio(int subscriptionId) {
+    std::lock_guard<ofMutex> lock(audioSubscriptionMutex);
+    if (!audioSubscriptions) return;
+    auto subscriptions = make_shared<vector<AudioSubscription>>();
+    for (auto & s : *audioSubscriptions) {
+        if (s.id != subscriptionId) subscriptions->push_back(s);
+    }
+    audioSubscriptions = subscriptions;
+    numAudioSubscriptions = subscriptions->size();
+}
+
+void ofxWhisper::setAudioPoolSize(int numBlocks) {
+    audioPoolSize = MAX(1, numBlocks);
+}
+
+ofxWhisper::CaptureSource * ofxWhisper::getSource(int sourceId) {
+    if (sourceId < 0 || sourceId >= numSources) return nullptr;
+    return sources[sourceId].get();
+}
+
+void ofxWhisper::startRecording() {
+    startRecording(0);
+}
+
+void ofxWhisper::startRecording(int sourceId) {
+    auto source = getSource(sourceId);
+    if (!source) return;
+    std::lock_guard<ofMutex> lock(source->recordingMutex);
+    if (source->recording) return;
+    
+    ofLogNotice("ofxWhisper") << "Start recording " << sourceId;
+    source->validBfferCount = 0;
+    source->recordingFrames = 0;
+    if (inMemoryRecording) {
+        source->recordingBufferMutex.lock();
+        source->recordingBuffer.clear();
+        source->recordingBuffer.setNumChannels(source->numChannels);
+        source->recordingBuffer.setSampleRate(source->sampleRate);
+        source->recordingBufferMutex.unlock();
+    } else {
+        source->recorder.startRecording(segmentStore.createPath("recording_" + ofToString(sourceId) + "_" + ofGetTimestampString(), "wav"), true);
+    }
+    source->stopping = false;
+    source->recording = true;
+}
+
+void ofxWhisper::stopRecording() {
+    stopRecording(0);
+}
+
+void ofxWhisper::stopRecording(int sourceId) {
+    auto source = getSource(sourceId);
+    if (!source) return;
+    
+    // only one of the app and the capture threads finishes the recording
+    AudioQueItem item;
+    bool inMemory = inMemoryRecording;
+    {
+        std::lock_guard<ofMutex> lock(source->recordingMutex);
+        if (!source->recording || source->stopping) return;
+        source->stopping = true;
+        
+        ofLogNotice("ofxWhisper") << "Stop recording " << sourceId;
+        if (streaming && sourceId == 0) streamingSegmentEnded = true;
+        
+        // the recording started pre-roll before startRecording()
+        source->recordingEndTime = ofGetElapsedTimeMillis();
+        source->recordingStartTime = source->recordingEndTime - MIN(source->recordingEndTime, source->recordingFrames * 1000 / MAX(1, source->sampleRate));
+        if (inMemory) {
+            source->recordingBufferMutex.lock();
+            item.buffer.swap(source->recordingBuffer);
+            source->recordingBufferMutex.unlock();
+        } else {
+            // recordingEndCallback() finishes it
+            source->recorder.stopRecording();
+        }
+    }
+    // outside the lock. adding to the queue can wait for room (see setOverflowPolicy()).
+    if (inMemory) finishRecording(*source, std::move(item));
+}
+
+void ofxWhisper::setInMemoryRecording(bool enabled) {
+    bool recording = false;
+    for (int i = 0; i < numSources; ++i) {
+        recording |= sources[i]->recording;
+    }
+    if (recording) {
+        ofLogWarning("ofxWhisper") << "Can not change recording mode while recording";
+        return;
+    }
+    inMemoryRecording = enabled;
+}
+
+bool ofxWhisper::isInMemoryRecording() const {
+    return inMemoryRecording;
+}
+
+bool ofxWhisper::setSegmentStorage(ofxWhisperSegmentStore::Type type, size_t maxBytes, string directory) {
+    bool ok = segmentStore.setup(type, maxBytes, directory);
+    if (!ok && type == ofxWhisperSegmentStore::Memory) {
+        // no tmpfs. keep segments in memory, not on disk.
+        ofLogNotice("ofxWhisper") << "Use in-memory recording";
+        setInMemoryRecording(true);
+    }
+    return ok;
+}
+
+ofxWhisperSegmentStore & ofxWhisper::getSegmentStore() {
+    return segmentStore;
+}
+
+void ofxWhisper::setSpeculativeUpload(bool enabled) {
+    if (enabled && !inMemoryRecording) {
+        ofLogWarning("ofxWhisper") << "Speculative upload needs in-memory recording (setInMemoryRecording(true))";
+    }
+    speculativeUpload = enabled;
+}
+
+bool ofxWhisper::isSpeculativeUpload() const {
+    return speculativeUpload;
+}
+
+void ofxWhisper::startSpeculativeUpload(CaptureSource & source) {
+    if (!inMemoryRecording || source.hasSpeculative || source.validBfferCount < validBfferCountThreshold) return;
+    
+    // the recording so far. the silence after this is not needed for the transcript.
+    AudioQueItem item;
+    source.recordingBufferMutex.lock();
+    item.buffer = source.recordingBuffer;
+    source.recordingBufferMutex.unlock();
+    if (item.buffer.size() == 0) return;
+    
+    item.speculative = true;
+    item.sourceId = source.id;
+    item.captureEndTime = ofGetElapsedTimeMillis();
+    item.captureStartTime = item.captureEndTime - MIN(item.captureEndTime, item.buffer.getNumFrames() * 1000 / MAX(1, source.sampleRate));
+    source.speculativeSequence = addToAudioQue(std::move(item));
+    source.speculativeFrames = source.recordingFrames;
+    source.hasSpeculative = true;
+    stats.numSpeculative++;
+}
+
+void ofxWhisper::resolveSpeculativeUpload(CaptureSource & source, bool confirmed, AudioQueItem * recording) {
+    if (!source.hasSpeculative) return;
+    source.hasSpeculative = false;
+    if (!confirmed) stats.numSpeculativeDiscarded++;
+    
+    uint64_t sequence = source.speculativeSequence;
+    std::unique_lock<ofMutex> lock(speculativeMutex);
+    auto & item = speculativeItems[sequence];
+    if (!item.finished) {
+        // delivered by finishSpeculativeItem()
+        item.state = confirmed ? SpeculativeConfirmed : SpeculativeDiscarded;
+        if (confirmed && recording) {
+            item.recording = std::move(*recording);
+            item.hasRecording = true;
+        }
+        return;
+    }
+    bool success = confirmed && item.success;
+    TranscriptResult result = std::move(item.result);
+    speculativeItems.erase(sequence);
+    lock.unlock();
+    
+    // the speculative request failed. the full recording takes its place.
+    if (confirmed && !success && recording) {
+        recording->sequence = sequence;
+        submitItem(std::move(*recording));
+        return;
+    }
+    deliverTranscript(sequence, success, std::move(result));
+}
+
+bool ofxWhisper::isSpeculativeDiscarded(uint64_t sequence) {
+    std::lock_guard<ofMutex> lock(speculativeMutex);
+    auto it = speculativeItems.find(sequence);
+    return it != speculativeItems.end() && it->second.state == SpeculativeDiscarded;
+}
+
+void ofxWhisper::finishSpeculativeItem(uint64_t sequence, bool success, TranscriptResult && result) {
+    std::unique_lock<ofMutex> lock(speculativeMutex);
+    auto & item = speculativeItems[sequence];
+    if (item.state == SpeculativePending) {
+        // held until the recording ends or speech starts again
+        item.finished = true;
+        item.success = success;
+        item.result = std::move(result);
+        return;
+    }
+    bool confirmed = item.state == SpeculativeConfirmed;
+    bool hasRecording = item.hasRecording;
+    AudioQueItem recording = std::move(item.recording);
+    speculativeItems.erase(sequence);
+    lock.unlock();
+    
+    // failed or cancelled. the full recording takes its place.
+    if (confirmed && !success && hasRecording) {
+        ofLogNotice("ofxWhisper") << "Speculative upload " << sequence << " failed. Send the recording";
+        recording.sequence = sequence;
+        submitItem(std::move(recording));
+        return;
+    }
+    deliverTranscript(sequence, confirmed && success, std::move(result));
+}
+
+bool ofxWhisper::isCapturing(CaptureSource & source) {
+    return inMemoryRecording ? source.recording.load() : source.recorder.isRecording();
+}
+
+void ofxWhisper::startRealtimeRecording() {
+    if (realtimeRecording.exchange(true)) return;
+    ofLogNotice("ofxWhisper") << "Start Realtime Recording";
+    for (int i = 0; i < numSources; ++i) {
+        sources[i]->rrSilenceCount = 0;
+    }
+}
+
+void ofxWhisper::stopRealtimeRecording() {
+    if (!realtimeRecording.exchange(false)) return;
+    for (int i = 0; i < numSources; ++i) {
+        stopRecording(i);
+    }
+    ofLogNotice("ofxWhisper") << "Stop Realtime Recording";
+}
+
+// rrStartThresholdのgetterとsetterの実装
+float ofxWhisper::getRrStartThreshold() const {
+    return rrStartThreshold;
+}
+
+void ofxWhisper::setRrStartThreshold(float value) {
+    rrStartThreshold = MIN(MAX(value, 0), 1.);
+    for (int i = 0; i < numSources; ++i) {
+        sources[i]->rrStartThreshold = rrStartThreshold;
+    }
+}
+
+// rrEndThresholdのgetterとsetterの実装
+float ofxWhisper::getRrEndThreshold() const {
+    return rrEndThreshold;
+}
+
+void ofxWhisper::setRrEndThreshold(float value) {
+    rrEndThreshold = MIN(MAX(value, 0), 1.);
+    for (int i = 0; i < numSources; ++i) {
+        sources[i]->rrEndThreshold = rrEndThreshold;
+    }
+}
+
+void ofxWhisper::setRrThresholds(int sourceId, float start, float end) {
+    auto source = getSource(sourceId);
+    if (!source) return;
+    source->rrStartThreshold = MIN(MAX(start, 0), 1.);
+    source->rrEndThreshold = MIN(MAX(end, 0), 1.);
+}
+
+// rrSilenceTimeMaxのgetterとsetterの実装
+float ofxWhisper::getRrSilenceTimeMax() const {
+    return rrSilenceTimeMax;
+}
+
+void ofxWhisper::setPreRollTime(float ms) {
+    // the capture thread reads the pre-roll buffers
+    captureWorker.waitForThread(true);
+    preRollTime = MAX(0, ms);
+    bool configured = false;
+    for (int i = 0; i < numSources; ++i) {
+        if (!sources[i]->configured) continue;
+        allocatePreRoll(*sources[i]);
+        configured = true;
+    }
+    if (configured) captureWorker.startThread();
+}
+
+float ofxWhisper::getPreRollTime() const {
+    return preRollTime;
+}
+
+void ofxWhisper::setPostRollTime(float ms) {
+    postRollTime = MAX(0, ms);
+}
+
+float ofxWhisper::getPostRollTime() const {
+    return postRollTime;
+}
+
+void ofxWhisper::setDcRemoval(bool enabled) {
+    dcRemoval = enabled;
+}
+
+bool ofxWhisper::isDcRemoval() const {
+    return dcRemoval;
+}
+
+void ofxWhisper::setRrSilenceTimeMax(float value) {
+    rrSilenceTimeMax = MAX(0, value);
+    for (int i = 0; i < numSources; ++i) {
+        auto & source = *sources[i];
+        source.rrSilenceCoutMax = rrSilenceTimeMax * source.sampleRate / source.bufferSize;
+    }
+}
+
+void ofxWhisper::setVad(shared_ptr<ofxWhisperVad> _vad) {
+    setVad(0, _vad);
+}
+
+void ofxWhisper::setVad(int sourceId, shared_ptr<ofxWhisperVad> _vad) {
+    auto source = getSource(sourceId);
+    if (!source) return;
+    source->vadMutex.lock();
+    source->vad = _vad;
+    if (_vad) _vad->reset();
+    source->vadMutex.unlock();
+}
+
+shared_ptr<ofxWhisperVad> ofxWhisper::getVad() {
+    return getVad(0);
+}
+
+shared_ptr<ofxWhisperVad> ofxWhisper::getVad(int sourceId) {
+    auto source = getSource(sourceId);
+    if (!source) return nullptr;
+    std::lock_guard<ofMutex> lock(source->vadMutex);
+    return source->vad;
+}
+
+float ofxWhisper::getVadStartThreshold() const {
+    return vadStartThreshold;
+}
+
+void ofxWhisper::setVadStartThreshold(float value) {
+    vadStartThreshold = MIN(MAX(value, 0), 1.);
+}
+
+float ofxWhisper::getVadEndThreshold() const {
+    return vadEndThreshold;
+}
+
+void ofxWhisper::setVadEndThreshold(float value) {
+    vadEndThreshold = MIN(MAX(value, 0), 1.);
+}
+
+float ofxWhisper::getSpeechProbability() {
+    return getSpeechProbability(0);
+}
+
+float ofxWhisper::getSpeechProbability(int sourceId) {
+    auto source = getSource(sourceId);
+    return source ? source->speechProbability : 0;
+}
+
+ofxWhisper::TranscriptHandle ofxWhisper::transcript(string file, CompletionCallback callback, Executor executor) {
+    AudioQueItem item;
+    item.filePath = file;
+    return addWithCompletion(std::move(item), callback, executor);
+}
+
+ofxWhisper::TranscriptHandle ofxWhisper::transcript(const ofSoundBuffer & buffer, CompletionCallback callback, Executor executor) {
+    AudioQueItem item;
+    item.buffer = buffer;
+    return addWithCompletion(std::move(item), callback, executor);
+}
+
+ofxWhisper::TranscriptHandle ofxWhisper::transcript(const float * samples, size_t numFrames, size_t numChannels, int sampleRate, CompletionCallback callback, Executor executor) {
+    AudioQueItem item;
+    item.buffer.copyFrom(samples, numFrames, numChannels, sampleRate);
+    return addWithCompletion(std::move(item), callback, executor);
+}
+
+ofxWhisper::TranscriptHandle ofxWhisper::addWithCompletion(AudioQueItem && item, CompletionCallback callback, Executor executor) {
+    auto completion = make_shared<Completion>();
+    completion->callback = callback;
+    completion->executor = executor;
+    TranscriptHandle handle;
+    handle.future = completion->promise.get_future().share();
+    
+    if (callback && executor == MainThread) {
+        std::lock_guard<ofMutex> lock(completionMutex);
+        if (!listeningUpdate) {
+            updateListener = ofEvents().update.newListener([this](ofEventArgs &) {
+                runMainThreadCompletions();
+            });
+            listeningUpdate = true;
+        }
+    } else if (callback) {
+        std::lock_guard<ofMutex> lock(completionMutex);
+        if (!completionWorker.isThreadRunning()) completionWorker.startThread();
+    }
+    
+    // registered by addToAudioQue() before a worker can take it
+    item.completion = completion;
+    handle.id = addToAudioQue(std::move(item));
+    return handle;
+}
+
+bool ofxWhisper::cancel(uint64_t id) {
+    AudioQueItem item;
+    {
+        std::lock_guard<ofMutex> lock(audioQueMutex);
+        auto it = std::find_if(audioQue.begin(), audioQue.end(), [id](const AudioQueItem & i) {
+            return i.sequence == id;
+        });
+        // chunks and batch files are cancelled with their job
+        if (it == audioQue.end() || it->longFileJob || it->batchJob) return false;
+        if (isQueueCounted(*it)) numQueuedItems--;
+        item = std::move(*it);
+        audioQue.erase(it);
+        stats.queueDepth.record(audioQue.size());
+    }
+    audioQueSpaceCondition.notify_all();
+    ofLogNotice("ofxWhisper") << "Cancel " << id;
+    
+    ofxWhisperResult result;
+    result.errorCode = Cancelled;
+    finishJournalItem(item, false, result);
+    if (item.recorded) segmentStore.release(item.filePath);
+    if (item.speculative) {
+        finishSpeculativeItem(item.sequence, false, makeTranscriptResult(item, result, item.queuedTime));
+    } else {
+        deliverTranscript(item.sequence, false, makeTranscriptResult(item, result, item.queuedTime));
+    }
+    return true;
+}
+
+uint64_t ofxWhisper::transcriptLongFile(string file, float chunkTime, float overlapTime) {
+    AudioQueItem item;
+    item.filePath = file;
+    item.longFile = true;
+    item.chunkTime = MAX(5, chunkTime);
+    item.overlapTime = MAX(0, overlapTime);
+    return addToAudioQue(std::move(item));
+}
+
+shared_ptr<ofxWhisperBatchJob> ofxWhisper::transcriptBatch(const vector<string> & files, int maxConcurrent, string jsonlPath, string srtDirectory) {
+    auto job = make_shared<ofxWhisperBatchJob>(files, maxConcurrent, jsonlPath, srtDirectory);
+    ofLogNotice("ofxWhisper") << "Batch of " << files.size() << " files";
+    submitBatchItems(job);
+    return job;
+}
+
+void ofxWhisper::submitBatchItems(const shared_ptr<ofxWhisperBatchJob> & job) {
+    size_t index;
+    string filePath;
+    while (job->takeNext(index, filePath)) {
+        AudioQueItem item;
+        item.filePath = filePath;
+        item.batchJob = job;
+        item.batchIndex = index;
+        uint64_t sequence = addToAudioQue(std::move(item));
+        
+        // batch results go to the job, so they don't hold back the delivery order
+        deliverTranscript(sequence, false, TranscriptResult());
+    }
+}
+
+void ofxWhisper::finishBatchItem(const AudioQueItem & item, bool success, bool cancelled, const ofxWhisperResult & result, uint64_t requestStartTime) {
+    auto r = makeTranscriptResult(item, result, requestStartTime);
+    r.latency = ofGetElapsedTimeMillis() - r.queuedTime;
+    if (success) stats.latency.record(r.latency);
+    
+    auto state = cancelled ? ofxWhisperBatchJob::Cancelled : success ? ofxWhisperBatchJob::Done : ofxWhisperBatchJob::Failed;
+    item.batchJob->finish(item.batchIndex, state, std::move(r));
+    submitBatchItems(item.batchJob);
+}
+
+uint64_t ofxWhisper::addToAudioQue(AudioQueItem && item) {
+    // workers are started first, so Block policy can wait for them
+    startWorkers();
+    
+    uint64_t sequence;
+    {
+        std::lock_guard<ofMutex> lock(audioQueMutex);
+        sequence = nextSequence++;
+        item.sequence = sequence;
+        if (item.completion) {
+            std::lock_guard<ofMutex> completionLock(completionMutex);
+            completions[sequence] = item.completion;
+        }
+    }
+    
+    submitItem(std::move(item));
+    return sequence;
+}
+
+void ofxWhisper::submitItem(AudioQueItem && item) {
+    // the file stays until the item is finished
+    if (item.recorded) segmentStore.pin(item.filePath);
+    item.queuedTime = ofGetElapsedTimeMillis();
+    item.prompt = item.batchJob || item.longFileJob ? getPrompt() : getContextPrompt();
+    
+    // write-ahead. the item is queued by the journal thread when it is on disk.
+    // the sequence keeps its place in the delivery order meanwhile.
+    if (isJournaled(item)) {
+        journalMutex.lock();
+        journalWrites.push_back(std::move(item));
+        journalMutex.unlock();
+        journalCondition.notify_one();
+    } else {
+        queueItem(std::move(item));
+    }
+}
+
+void ofxWhisper::queueItem(AudioQueItem && item) {
+    vector<AudioQueItem> skipped;
+    {
+        std::unique_lock<ofMutex> lock(audioQueMutex);
+        bool counted = isQueueCounted(item);
+        bool queued = true;
+        if (counted && maxQueueSize > 0 && numQueuedItems >= maxQueueSize) {
+            queued = handleOverflow(lock, item, skipped);
+        }
+        if (queued) {
+            if (counted) numQueuedItems++;
+            audioQue.push_back(std::move(item));
+        }
+        stats.queueDepth.record(audioQue.size());
+    }
+    audioQueCondition.notify_one();
+    
+    // dropped and merged items just advance the delivery order
+    for (auto & s : skipped) {
+        finishJournalItem(s, false, ofxWhisperResult());
+        if (s.recorded) segmentStore.release(s.filePath);
+        if (s.speculative) {
+            finishSpeculativeItem(s.sequence, false, makeTranscriptResult(s, ofxWhisperResult(), s.queuedTime));
+        } else {
+            deliverTranscript(s.sequence, false, makeTranscriptResult(s, ofxWhisperResult(), s.queuedTime));
+        }
+    }
+}
+
+bool ofxWhisper::isQueueCounted(const AudioQueItem & item) {
+    // chunks, retries and replays are already accepted work. batch jobs limit themselves.
+    return !item.longFileJob && !item.batchJob && item.attempts == 0 && !item.replay;
+}
+
+bool ofxWhisper::handleOverflow(std::unique_lock<ofMutex> & lock, AudioQueItem & item, vector<AudioQueItem> & skipped) {
+    // an upload worker (e.g. transcript() in a transcriptEvents listener) would wait for itself.
+    // the new item is dropped instead (DropNewest).
+    bool block = overflowPolicy == Block && !isUploadWorker();
+    if (block) {
+        while (overflowPolicy == Block && maxQueueSize > 0 && numQueuedItems >= maxQueueSize && isThreadRunning()) {
+            audioQueSpaceCondition.wait_for(lock, std::chrono::milliseconds(100));
+        }
+        return true;
+    }
+    
+    if (overflowPolicy == MergeAdjacent && mergeWithLastItem(item)) {
+        stats.numQueueMerged++;
+        skipped.push_back(std::move(item));
+        return false;
+    }
+    
+    stats.numQueueDropped++;
+    numDropped++;
+    if (overflowPolicy == DropNewest || overflowPolicy == Block) {
+        ofLogWarning("ofxWhisper") << "Queue is full. Drop the new item";
+        skipped.push_back(std::move(item));
+        return false;
+    }
+    
+    // DropOldest (and MergeAdjacent when the audio can not be merged)
+    auto oldest = std::find_if(audioQue.begin(), audioQue.end(), isQueueCounted);
+    if (oldest != audioQue.end()) {
+        ofLogWarning("ofxWhisper") << "Queue is full. Drop the oldest item";
+        skipped.push_back(std::move(*oldest));
+        audioQue.erase(oldest);
+        numQueuedItems--;
+    }
+    return true;
+}
+
+bool ofxWhisper::isUploadWorker() {
+    if (isCurrentThread()) return true;
+    for (auto & worker : uploadWorkers) {
+        if (worker->isCurrentThread()) return true;
+    }
+    return false;
+}
+
+bool ofxWhisper::mergeWithLastItem(AudioQueItem & item) {
+    auto last = std::find_if(audioQue.rbegin(), audioQue.rend(), isQueueCounted);
+    if (last == audioQue.rend()) return false;
+    
+    // in-memory audio of the same source and format
+    auto & a = last->buffer;
+    auto & b = item.buffer;
+    if (!last->filePath.empty() || !item.filePath.empty() || a.size() == 0 || b.size() == 0) return false;
+    if (last->longFile || item.longFile || last->sourceId != item.sourceId) return false;
+    // each of them has its own result
+    if (last->completion || item.completion) return false;
+    if (a.getSampleRate() != b.getSampleRate() || a.getNumChannels() != b.getNumChannels()) return false;
+    
+    a.append(b);
+    last->captureEndTime = item.captureEndTime;
+    b.clear();
+    return true;
+}
+
+void ofxWhisper::setMaxQueueSize(size_t num, OverflowPolicy policy) {
+    audioQueMutex.lock();
+    maxQueueSize = num;
+    overflowPolicy = policy;
+    audioQueMutex.unlock();
+    audioQueSpaceCondition.notify_all();
+}
+
+size_t ofxWhisper::getMaxQueueSize() const {
+    return maxQueueSize;
+}
+
+ofxWhisper::OverflowPolicy ofxWhisper::getOverflowPolicy() const {
+    return overflowPolicy;
+}
+
+size_t ofxWhisper::getQueueSize() {
+    std::lock_guard<ofMutex> lock(audioQueMutex);
+    return audioQue.size();
+}
+
+void ofxWhisper::setPrompt(string _prompt) {
+    std::lock_guard<ofMutex> lock(contextMutex);
+    prompt = _prompt;
+}
+
+string ofxWhisper::getPrompt() {
+    std::lock_guard<ofMutex> lock(contextMutex);
+    return prompt;
+}
+
+void ofxWhisper::setAutoContext(bool enabled, int maxTokens) {
+    std::lock_guard<ofMutex> lock(contextMutex);
+    autoContext = enabled;
+    contextMaxTokens = MAX(1, maxTokens);
+}
+
+bool ofxWhisper::isAutoContext() const {
+    return autoContext;
+}
+
+string ofxWhisper::getContextPrompt() {
+    std::lock_guard<ofMutex> lock(contextMutex);
+    if (!autoContext || contextText.empty()) return prompt;
+    
+    // the prompt may have been changed
+    trimContext(getContextBudget());
+    if (prompt.empty()) return contextText;
+    return prompt + " " + contextText;
+}
+
+void ofxWhisper::clearContext() {
+    std::lock_guard<ofMutex> lock(contextMutex);
+    contextEntries.clear();
+    contextText.clear();
+    contextTokens = 0;
+}
+
+void ofxWhisper::addToContext(string text) {
+    text = ofTrim(text);
+    if (text.empty()) return;
+    
+    std::lock_guard<ofMutex> lock(contextMutex);
+    if (!autoContext) return;
+    float budget = getContextBudget();
+    float tokens = estimateTokens(text);
+    if (tokens > budget) {
+        // keep the end of a long transcript
+        size_t cut = text.size();
+        tokens = 0;
+        while (cut > 0) {
+            size_t start = cut - 1;
+            while (start > 0 && (text[start] & 0xC0) == 0x80) start--;
+            float cost = (unsigned char)text[start] < 0x80 ? 0.25 : 1;
+            if (tokens + cost > budget) break;
+            tokens += cost;
+            cut = start;
+        }
+        text = ofTrim(text.substr(cut));
+        if (text.empty()) return;
+    }
+    
+    if (!contextText.empty()) {
+        text = " " + text;
+        tokens += 0.25;
+    }
+    contextText += text;
+    contextEntries.push_back({text.size(), tokens});
+    contextTokens += tokens;
+    trimContext(budget);
+}
+
+void ofxWhisper::trimContext(float budget) {
+    size_t removed = 0;
+    // the newest entry is kept (it was cut to the budget in addToContext())
+    while (contextTokens > budget && contextEntries.size() > 1) {
+        removed += contextEntries.front().length;
+        contextTokens -= contextEntries.front().tokens;
+        contextEntries.pop_front();
+    }
+    if (removed == 0) return;
+    contextText.erase(0, removed);
+    
+    // separator of the new first entry
+    if (!contextText.empty() && contextText[0] == ' ') {
+        contextText.erase(0, 1);
+        contextEntries.front().length--;
+        contextEntries.front().tokens -= 0.25;
+        contextTokens -= 0.25;
+    }
+}
+
+float ofxWhisper::getContextBudget() const {
+    // space between the prompt and the context
+    float promptTokens = prompt.empty() ? 0 : estimateTokens(prompt) + 0.25;
+    return MAX(0, contextMaxTokens - promptTokens);
+}
+
+float ofxWhisper::estimateTokens(const string & text) {
+    float tokens = 0;
+    for (unsigned char c : text) {
+        if (c < 0x80) {
+            tokens += 0.25;
+        } else if ((c & 0xC0) != 0x80) {
+            // first byte of a multi byte character
+            tokens += 1;
+        }
+    }
+    return tokens;
+}
+
+void ofxWhisper::setLanguage(string _language) {
+    language = _language;
+}
+
+string ofxWhisper::getLanguage() {
+    return language;
+}
+
+void ofxWhisper::setUploadResample(bool enabled) {
+    uploadResample = enabled;
+}
+
+bool ofxWhisper::isUploadResample() const {
+    return uploadResample;
+}
+
+void ofxWhisper::setUploadFormat(ofxWhisperEncoder::Format format) {
+    if (!ofxWhisperEncoder::isAvailable(format)) {
+        ofLogWarning("ofxWhisper") << ofxWhisperEncoder::getExtension(format) << " encoder is not available in this build";
+    }
+    uploadFormat = format;
+}
+
+ofxWhisperEncoder::Format ofxWhisper::getUploadFormat() const {
+    return uploadFormat;
+}
+
+void ofxWhisper::setNumWorkers(int num) {
+    num = MAX(1, num);
+    // this thread is the first worker
+    size_t numExtra = num - 1;
+    while (uploadWorkers.size() > numExtra) {
+        // wait for the request in flight
+        uploadWorkers.back()->stopThread();
+        audioQueCondition.notify_all();
+        uploadWorkers.back()->waitForThread(false);
+        uploadWorkers.pop_back();
+    }
+    while (uploadWorkers.size() < numExtra) {
+        uploadWorkers.emplace_back(new UploadWorker(*this));
+        if (isThreadRunning()) uploadWorkers.back()->startThread();
+    }
+}
+
+int ofxWhisper::getNumWorkers() const {
+    return (int)uploadWorkers.size() + 1;
+}
+
+void ofxWhisper::setMaxInFlight(int num) {
+    audioQueMutex.lock();
+    maxInFlight = MAX(1, num);
+    audioQueMutex.unlock();
+    audioQueCondition.notify_all();
+}
+
+int ofxWhisper::getMaxInFlight() const {
+    return maxInFlight;
+}
+
+void ofxWhisper::startWorkers() {
+    if (!isThreadRunning()) startThread();
+    if (journal && !journalWorker.isThreadRunning()) journalWorker.startThread();
+    for (auto & worker : uploadWorkers) {
+        if (!worker->isThreadRunning()) worker->startThread();
+    }
+}
+
+void ofxWhisper::threadedFunction() {
+    processAudioQue(*this);
+}
+
+void ofxWhisper::processAudioQue(ofThread & worker) {
+    while (worker.isThreadRunning()) {
+        saveStatsFile();
+        drainJournal();
+        
+        AudioQueItem item;
+        {
+            // items waiting for retry or rate limit are skipped
+            std::unique_lock<ofMutex> lock(audioQueMutex);
+            auto next = audioQue.end();
+            audioQueCondition.wait_for(lock, std::chrono::milliseconds(100), [this, &next] {
+                next = findReadyItem();
+                return next != audioQue.end() && inFlight < maxInFlight;
+            });
+            if (next == audioQue.end() || inFlight >= maxInFlight) continue;
+            if (isQueueCounted(*next)) numQueuedItems--;
+            item = std::move(*next);
+            audioQue.erase(next);
+            inFlight++;
+            stats.queueDepth.record(audioQue.size());
+        }
+        audioQueSpaceCondition.notify_all();
+        
+        uint64_t requestStartTime = ofGetElapsedTimeMillis();
+        stats.queueWait.record(requestStartTime - item.queuedTime);
+        ofxWhisperResult result;
+        bool success, retry = false;
+        bool cancelled = (item.batchJob && item.batchJob->isCancelled()) || (item.speculative && isSpeculativeDiscarded(item.sequence));
+        if (cancelled) {
+            success = false;
+        } else if (item.longFile) {
+            success = splitLongFile(item);
+        } else {
+            result = processAudioQueItem(item);
+            updateRateLimit(result);
+            success = result.errorCode == Success;
+            
+            // item is moved back to audioQue if it is retried
+            if (!success) retry = scheduleRetry(item, result);
+        }
+        
+        audioQueMutex.lock();
+        inFlight--;
+        audioQueMutex.unlock();
+        audioQueCondition.notify_one();
+        
+        if (retry) continue;
+        bool parked = finishJournalItem(item, success, result);
+        if (item.recorded) segmentStore.release(item.filePath);
+        if (parked) {
+            // its place in the order is released. the replay is delivered when it is done.
+            deliverTranscript(item.sequence, false, makeTranscriptResult(item, result, requestStartTime));
+            continue;
+        }
+        
+        if (item.longFile) {
+            // the transcript is delivered when all chunks are done
+            if (!success) deliverTranscript(item.sequence, false, makeTranscriptResult(item, result, requestStartTime));
+        } else if (item.longFileJob) {
+            finishLongFileChunk(item, success, result, requestStartTime);
+        } else if (item.batchJob) {
+            finishBatchItem(item, success, cancelled, result, requestStartTime);
+        } else if (item.speculative) {
+            finishSpeculativeItem(item.sequence, success, makeTranscriptResult(item, result, requestStartTime));
+        } else {
+            deliverTranscript(item.sequence, success, makeTranscriptResult(item, result, requestStartTime));
+        }
+    }
+}
+
+bool ofxWhisper::splitLongFile(const AudioQueItem & item) {
+    ofxAudioFile audioFile;
+    audioFile.load(item.filePath);
+    if (!audioFile.loaded()) {
+        ofLogError("ofxWhisper") << "Failed to decode " << item.filePath;
+        return false;
+    }
+    
+    // chunks are 16kHz mono from the beginning, so the whole file is not kept at the original rate
+    vector<float> pcm;
+    ofxWhisperResampler::toMono(audioFile.data(), audioFile.length(), audioFile.channels(), audioFile.samplerate(), uploadSampleRate, pcm);
+    audioFile.free();
+    
+    vector<pair<size_t, size_t>> ranges;
+    splitAtLowEnergy(pcm, uploadSampleRate, item.chunkTime, item.overlapTime, ranges);
+    if (ranges.empty()) {
+        ofLogError("ofxWhisper") << "No audio in " << item.filePath;
+        return false;
+    }
+    ofLogNotice("ofxWhisper") << "Split " << item.filePath << " into " << ranges.size() << " chunks";
+    
+    auto job = make_shared<LongFileJob>();
+    job->sequence = item.sequence;
+    job->filePath = item.filePath;
+    job->texts.resize(ranges.size());
+    job->segments.resize(ranges.size());
+    job->words.resize(ranges.size());
+    job->duration = (float)pcm.size() / uploadSampleRate;
+    job->queuedTime = item.queuedTime;
+    for (auto & range : ranges) {
+        job->chunkStartTimes.push_back((float)range.first / uploadSampleRate);
+    }
+    
+    audioQueMutex.lock();
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        AudioQueItem chunk;
+        chunk.buffer.copyFrom(pcm.data() + ranges[i].first, ranges[i].second - ranges[i].first, 1, uploadSampleRate);
+        chunk.sequence = item.sequence;
+        chunk.longFileJob = job;
+        chunk.chunkIndex = i;
+        chunk.queuedTime = item.queuedTime;
+        audioQue.push_back(std::move(chunk));
+    }
+    audioQueMutex.unlock();
+    audioQueCondition.notify_all();
+    
+    LongFileEventArgs args;
+    args.id = job->sequence;
+    args.filePath = job->filePath;
+    args.numChunks = ranges.size();
+    ofNotifyEvent(longFileEvents, args);
+    return true;
+}
+
+void ofxWhisper::finishLongFileChunk(const AudioQueItem & item, bool success, const ofxWhisperResult & result, uint64_t requestStartTime) {
+    auto & job = item.longFileJob;
+    LongFileEventArgs args;
+    TranscriptResult transcriptResult;
+    longFileMutex.lock();
+    job->texts[item.chunkIndex] = success ? result.text : "";
+    if (success) {
+        job->segments[item.chunkIndex] = result.segments;
+        job->words[item.chunkIndex] = result.words;
+        if (job->language == "") job->language = result.language;
+        if (result.serverTime > 0) job->serverTime += result.serverTime;
+    } else {
+        job->numFailed++;
+    }
+    job->requestTime += ofGetElapsedTimeMillis() - requestStartTime;
+    job->attempts += item.attempts + 1;
+    job->numDone++;
+    args.id = job->sequence;
+    args.filePath = job->filePath;
+    args.numChunks = job->texts.size();
+    args.numDone = job->numDone;
+    args.progress = (float)args.numDone / args.numChunks;
+    args.isFinished = args.numDone == args.numChunks;
+    if (args.isFinished) {
+        args.transcript = stitchTranscripts(job->texts);
+        
+        // chunk timestamps to file timestamps. segments already covered by the previous chunk (overlap) are skipped.
+        auto & r = transcriptResult;
+        r.id = job->sequence;
+        r.filePath = job->filePath;
+        r.text = args.transcript;
+        r.language = job->language != "" ? job->language : language;
+        r.duration = job->duration;
+        float segmentEnd = 0, wordEnd = 0;
+        for (size_t i = 0; i < job->segments.size(); ++i) {
+            float offset = job->chunkStartTimes[i];
+            for (auto segment : job->segments[i]) {
+                segment.start += offset;
+                segment.end += offset;
+                if (segment.end <= segmentEnd) continue;
+                segmentEnd = segment.end;
+                r.segments.push_back(segment);
+            }
+            for (auto word : job->words[i]) {
+                word.start += offset;
+                word.end += offset;
+                if (word.end <= wordEnd) continue;
+                wordEnd = word.end;
+                r.words.push_back(word);
+            }
+        }
+        r.queuedTime = job->queuedTime;
+        r.requestTime = job->requestTime;
+        r.serverTime = job->serverTime > 0 ? job->serverTime : -1;
+        r.attempts = job->attempts;
+    }
+    longFileMutex.unlock();
+    
+    ofNotifyEvent(longFileEvents, args);
+    
+    if (args.isFinished) {
+        if (job->numFailed > 0) {
+            ofLogWarning("ofxWhisper") << job->numFailed << " chunks of " << job->filePath << " failed";
+        }
+        transcriptResult.confidence = getConfidence(transcriptResult.segments);
+        deliverTranscript(job->sequence, job->numFailed < args.numChunks, std::move(transcriptResult));
+    }
+}
+
+void ofxWhisper::splitAtLowEnergy(const vector<float> & pcm, int sampleRate, float chunkTime, float overlapTime, vector<pair<size_t, size_t>> & ranges) {
+    size_t chunkSize = chunkTime * sampleRate;
+    size_t overlap = MIN(overlapTime * sampleRate, chunkSize / 4);
+    size_t frameSize = sampleRate / 50; // 20ms
+    
+    size_t start = 0;
+    while (start < pcm.size()) {
+        size_t end = start + chunkSize;
+        if (end >= pcm.size()) {
+            end = pcm.size();
+        } else {
+            // cut at the quietest frame in the last quarter of the chunk
+            float minEnergy = std::numeric_limits<float>::max();
+            size_t cut = end;
+            for (size_t pos = start + chunkSize * 3 / 4; pos + frameSize <= end; pos += frameSize / 2) {
+                float energy = 0;
+                for (size_t i = pos; i < pos + frameSize; ++i) {
+                    energy += pcm[i] * pcm[i];
+                }
+                if (energy < minEnergy) {
+                    minEnergy = energy;
+                    cut = pos + frameSize / 2;
+                }
+            }
+            end = cut;
+        }
+        ranges.emplace_back(start > overlap ? start - overlap : 0, end);
+        start = end;
+    }
+}
+
+string ofxWhisper::stitchTranscripts(const vector<string> & texts, size_t maxOverlapWords) {
+    auto normalize = [](const string & word) {
+        string n;
+        for (auto c : word) {
+            if ((unsigned char)c >= 0x80 || isalnum((unsigned char)c)) n += tolower((unsigned char)c);
+        }
+        return n;
+    };
+    
+    string stitched;
+    vector<string> tail;
+    for (auto & text : texts) {
+        auto words = ofSplitString(text, " ", true, true);
+        if (words.empty()) continue;
+        
+        // the longest tail of the stitched words that matches the head of the next text
+        size_t overlap = 0;
+        for (size_t k = MIN(maxOverlapWords, MIN(tail.size(), words.size())); k > 0; --k) {
+            bool match = true;
+            for (size_t j = 0; j < k && match; ++j) {
+                match = normalize(tail[tail.size() - k + j]) == normalize(words[j]);
+            }
+            if (match) {
+                overlap = k;
+                break;
+            }
+        }
+        
+        string next = ofJoinString(vector<string>(words.begin() + overlap, words.end()), " ");
+        
+        // no space between words (e.g. Japanese). match characters instead.
+        if (overlap == 0 && tail.size() > 0 && isUnspacedJoin(stitched, next)) {
+            size_t maxBytes = MIN(stitched.size(), next.size());
+            for (size_t k = maxBytes; k >= 6; --k) {
+                // keep utf-8 characters
+                if (k < next.size() && ((unsigned char)next[k] & 0xC0) == 0x80) continue;
+                if (stitched.compare(stitched.size() - k, k, next, 0, k) == 0) {
+                    next = next.substr(k);
+                    break;
+                }
+            }
+        }
+        
+        if (next.empty()) continue;
+        if (!stitched.empty() && !isUnspacedJoin(stitched, next)) stitched += " ";
+        stitched += next;
+        
+        tail.insert(tail.end(), words.begin() + overlap, words.end());
+        if (tail.size() > maxOverlapWords) {
+            tail.erase(tail.begin(), tail.end() - maxOverlapWords);
+        }
+    }
+    return stitched;
+}
+
+bool ofxWhisper::isUnspacedJoin(const string & left, const string & right) {
+    if (left.empty() || right.empty()) return false;
+    
+    // utf-8 character from i
+    auto decode = [](const string & text, size_t i) {
+        unsigned char c = text[i];
+        uint32_t code = c;
+        size_t length = 1;
+        if (c >= 0xF0) {
+            code = c & 0x07;
+            length = 4;
+        } else if (c >= 0xE0) {
+            code = c & 0x0F;
+            length = 3;
+        } else if (c >= 0xC0) {
+            code = c & 0x1F;
+            length = 2;
+        }
+        for (size_t j = 1; j < length && i + j < text.size(); ++j) {
+            code = (code << 6) | (text[i + j] & 0x3F);
+        }
+        return code;
+    };
+    // scripts written without spaces between words
+    auto isUnspaced = [](uint32_t code) {
+        return (code >= 0x0E00 && code <= 0x0EFF) || // Thai, Lao
+            (code >= 0x1000 && code <= 0x109F) || // Myanmar
+            (code >= 0x1780 && code <= 0x17FF) || // Khmer
+            (code >= 0x3000 && code <= 0x30FF) || // CJK punctuation, kana
+            (code >= 0x3400 && code <= 0x4DBF) || // CJK extension A
+            (code >= 0x4E00 && code <= 0x9FFF) || // CJK
+            (code >= 0xF900 && code <= 0xFAFF) || // CJK compatibility
+            (code >= 0xFF00 && code <= 0xFFEF) || // fullwidth forms
+            (code >= 0x20000 && code <= 0x2FFFF); // CJK extension B-
+    };
+    
+    // the last character of left
+    size_t last = left.size() - 1;
+    while (last > 0 && ((unsigned char)left[last] & 0xC0) == 0x80) last--;
+    return isUnspaced(decode(left, last)) || isUnspaced(decode(right, 0));
+}
+
+ofxWhisperResult ofxWhisper::processAudioQueItem(const AudioQueItem & item) {
+    const string & soundFilePath = item.filePath;
+    ofxWhisperResult result;
+    
+    if (item.buffer.size() == 0) {
+        if (soundFilePath == "") return result;
+        
+        uint64_t waitStartTime = ofGetElapsedTimeMicros();
+        int tryCount = 0;
+        while (!ofFile(soundFilePath).exists()) {
+            if (tryCount++ == 10) break;
+            ofSleepMillis(100);
+        }
+        stats.fileWait.record((ofGetElapsedTimeMicros() - waitStartTime) * 0.001);
+        
+        if (!ofFile(soundFilePath).exists()) {
+            ofLogError("ofxWhisper") << "Data " << soundFilePath << " is not exists.";
+            return result;
+        }
+    }
+    
+    if (!backend) {
+        ofLogError("ofxWhisper") << "No backend. Call setup() first.";
+        return result;
+    }
+    
+    ofxWhisperBackend::Request request;
+    request.filePath = item.filePath;
+    request.prompt = item.prompt;
+    request.language = language;
+    request.format = uploadFormat;
+    uint64_t prepareStartTime = ofGetElapsedTimeMicros();
+    
+    // recorded wav is decoded to be resampled or encoded.
+    // other files are uploaded as they are. they are decoded only for the cache key.
+    auto cache = this->cache;
+    bool uploadDecoded = item.buffer.size() > 0 || (item.recorded && (uploadResample || uploadFormat != ofxWhisperEncoder::Wav));
+    ofSoundBuffer decoded;
+    const ofSoundBuffer * source = &item.buffer;
+    if (item.buffer.size() == 0 && (uploadDecoded || cache)) {
+        ofxAudioFile audioFile;
+        audioFile.load(item.filePath);
+        if (audioFile.loaded()) {
+            decoded.copyFrom(audioFile.data(), audioFile.length(), audioFile.channels(), audioFile.samplerate());
+            source = &decoded;
+        }
+    }
+    
+    ofxWhisperCache::Key cacheKey;
+    if (cache && source->size() > 0) {
+        cacheKey = ofxWhisperCache::makeKey(*source, request.prompt, language, backend->getModel());
+        string cached;
+        if (cache->get(cacheKey, cached) && ofxWhisperBackend::parseVerboseJson(cached, result)) {
+            ofLogVerbose("ofxWhisper") << "Got transcript from cache: " << result.text;
+            result.errorCode = Success;
+            result.fromCache = true;
+            stats.numCacheHits++;
+            stats.prepare.record((ofGetElapsedTimeMicros() - prepareStartTime) * 0.001);
+            return result;
+        }
+    }
+    
+    if (uploadDecoded && source->size() > 0) {
+        if (uploadResample) {
+            // Whisper uses 16kHz mono internally
+            ofxWhisperResampler::toMono(*source, uploadSampleRate, request.buffer);
+        } else {
+            request.buffer = *source;
+        }
+    }
+    
+    uint64_t requestStartTime = ofGetElapsedTimeMicros();
+    stats.prepare.record((requestStartTime - prepareStartTime) * 0.001);
+    
+    result = backend->transcribe(request);
+    
+    stats.request.record((ofGetElapsedTimeMicros() - requestStartTime) * 0.001);
+    if (result.serverTime >= 0) stats.server.record(result.serverTime);
+    if (result.parseTime >= 0) stats.parse.record(result.parseTime);
+    stats.numRequests++;
+    stats.bytesUploaded += result.bytesSent;
+    if (result.errorCode == Success) {
+        stats.numSucceeded++;
+        if (result.duration > 0) {
+            stats.audioMillis += result.duration * 1000;
+        } else if (request.buffer.size() > 0) {
+            stats.audioMillis += request.buffer.getDurationMS();
+        }
+    } else {
+        stats.numFailed++;
+    }
+    
+    if (result.errorCode == Success) {
+        ofLogVerbose("ofxWhisper") << "Got transcript: " << result.text;
+        if (cache) cache->put(cacheKey, ofxWhisperBackend::toVerboseJson(result));
+    } else {
+        ofLogError("ofxWhisper") << getErrorMessage(result.errorCode);
+        ofLogVerbose("ofxWhisper") << "Data: " << result.rawResponse;
+    }
+    return result;
 }
 
-ofxWhisper::~ofxWhisper() {
-    stopThread();
-    waitForThread();
+bool ofxWhisper::isRetryable(const ofxWhisperResult & result) {
+    auto code = result.errorCode;
+    return code == RateLimitExceeded || code == ServerError || code == Timeout || code == NetworkError;
+}
+
+bool ofxWhisper::scheduleRetry(AudioQueItem & item, const ofxWhisperResult & result) {
+    bool retryable = isRetryable(result);
+    uint64_t now = ofGetElapsedTimeMillis();
+    if (item.attempts == 0) item.firstFailureTime = now;
     
-    // delete wav files
-    string path = getTempPath();
-    if (ofFile(path).isDirectory()) {
-        auto d = ofDirectory(path);
-        d.remove(true);
+    if (!retryable || item.attempts >= maxRetries) {
+        numDropped++;
+        return false;
+    }
+    
+    // jittered exponential backoff. Retry-After is the minimum.
+    float delay = MIN(retryDelayMax, retryDelayBase * pow(2, item.attempts)) * ofRandom(0.5, 1.0);
+    if (result.retryAfter > 0) delay = MAX(delay, result.retryAfter);
+    
+    if (now + delay * 1000 - item.firstFailureTime > retryTimeMax * 1000) {
+        ofLogWarning("ofxWhisper") << "Give up retrying after " << item.attempts << " attempts";
+        numDropped++;
+        return false;
     }
+    
+    item.attempts++;
+    item.notBefore = now + delay * 1000;
+    numRetried++;
+    ofLogNotice("ofxWhisper") << "Retry " << item.attempts << " in " << delay << " sec";
+    
+    audioQueMutex.lock();
+    audioQue.push_back(std::move(item));
+    audioQueMutex.unlock();
+    audioQueCondition.notify_one();
+    return true;
 }
 
-void ofxWhisper::setup(string api_key) {
-    apiKey = api_key;
+void ofxWhisper::updateRateLimit(const ofxWhisperResult & result) {
+    uint64_t now = ofGetElapsedTimeMillis();
+    uint64_t pauseUntil = 0;
+    
+    // no request is left in this window. wait for the reset.
+    if (result.rateLimitRemaining == 0 && result.rateLimitReset > 0) {
+        pauseUntil = now + result.rateLimitReset * 1000;
+    }
+    if (result.errorCode == RateLimitExceeded && result.retryAfter > 0) {
+        pauseUntil = MAX(pauseUntil, now + result.retryAfter * 1000);
+    }
     
-    if (!ofFile(getTempPath()).exists()){
-        ofDirectory(getTempPath()).create();
+    if (pauseUntil > 0) {
+        audioQueMutex.lock();
+        if (pauseUntil > rateLimitPausedUntil) {
+            ofLogNotice("ofxWhisper") << "Rate limit. Pause requests for " << (pauseUntil - now) / 1000. << " sec";
+            rateLimitPausedUntil = pauseUntil;
+        }
+        audioQueMutex.unlock();
     }
 }
 
-void ofxWhisper::printSoundDevices() {
-    return ofxSoundUtils::printInputSoundDevices();
+deque<ofxWhisper::AudioQueItem>::iterator ofxWhisper::findReadyItem() {
+    uint64_t now = ofGetElapsedTimeMillis();
+    if (now < rateLimitPausedUntil) return audioQue.end();
+    return std::find_if(audioQue.begin(), audioQue.end(), [now](const AudioQueItem & item) {
+        return item.notBefore <= now;
+    });
 }
 
-vector<ofSoundDevice> ofxWhisper::getSoundDevices() {
-    return ofxSoundUtils::getInputSoundDevices();
+void ofxWhisper::setMaxRetries(int num) {
+    maxRetries = MAX(0, num);
 }
 
-void ofxWhisper::setupRecorder(int _soundDeviceID) {
-    auto inDevices = ofxSoundUtils::getInputSoundDevices();
+int ofxWhisper::getMaxRetries() const {
+    return maxRetries;
+}
+
+void ofxWhisper::setRetryTimeMax(float sec) {
+    retryTimeMax = MAX(0, sec);
+}
+
+float ofxWhisper::getRetryTimeMax() const {
+    return retryTimeMax;
+}
+
+int ofxWhisper::getNumRetried() const {
+    return numRetried;
+}
+
+int ofxWhisper::getNumDropped() const {
+    return numDropped;
+}
+
+ofxWhisperStats::Snapshot ofxWhisper::getStats() const {
+    auto snapshot = stats.getSnapshot();
+    snapshot.counters["retried_total"] = numRetried;
+    snapshot.counters["dropped_total"] = numDropped;
+    return snapshot;
+}
+
+void ofxWhisper::resetStats() {
+    stats.reset();
+}
+
+void ofxWhisper::setStatsFile(string path, float interval) {
+    statsFileMutex.lock();
+    statsFile = path;
+    statsInterval = MAX(0.1, interval);
+    nextStatsTime = 0;
+    statsFileMutex.unlock();
+    startWorkers();
+}
+
+void ofxWhisper::saveStatsFile() {
+    // one of the workers writes the file
+    uint64_t now = ofGetElapsedTimeMillis();
+    uint64_t next = nextStatsTime;
+    if (now < next) return;
     
-    size_t inDeviceIndex = _soundDeviceID;
+    std::unique_lock<ofMutex> lock(statsFileMutex, std::try_to_lock);
+    if (!lock.owns_lock() || statsFile == "" || nextStatsTime != next) return;
+    nextStatsTime = now + statsInterval * 1000;
+    ofxWhisperStats::save(getStats(), statsFile);
+}
+
+void ofxWhisper::setJournal(string directory, float drainInterval, int maxAttempts) {
+    shared_ptr<ofxWhisperJournal> _journal;
+    if (directory != "") {
+        _journal = make_shared<ofxWhisperJournal>();
+        if (!_journal->setup(directory)) _journal = nullptr;
+    }
     
-    // Setup the sound stream.
-    ofSoundStreamSettings settings;
-    settings.bufferSize = 256;
-    settings.numBuffers = 1;
-    settings.numInputChannels = MIN(2, inDevices[inDeviceIndex].inputChannels);
-    settings.numOutputChannels = MIN(2, inDevices[inDeviceIndex].outputChannels);
-    settings.sampleRate = inDevices[inDeviceIndex].sampleRates[0];
-    settings.setInDevice(inDevices[inDeviceIndex]);
-    settings.setInListener(this);
+    // items of the last run are sent again by the workers
+    vector<JournalEntry> replays;
+    if (_journal) {
+        for (auto id : _journal->getPendingIds()) {
+            JournalEntry entry;
+            entry.id = id;
+            replays.push_back(entry);
+        }
+    }
     
-    stream.setup(settings);
+    journalMutex.lock();
+    journal = _journal;
+    journalDrainInterval = MAX(0.01, drainInterval);
+    journalMaxAttempts = MAX(1, maxAttempts);
+    journalBackoff = 1;
+    nextJournalDrainTime = 0;
+    
+    // items parked in the old journal are not sent any more
+    journalParked.assign(replays.begin(), replays.end());
+    journalMutex.unlock();
+    
+    if (!replays.empty()) startWorkers();
+}
+
+size_t ofxWhisper::getNumJournalPending() {
+    auto journal = this->journal;
+    return journal ? journal->getNumPending() : 0;
+}
+
+bool ofxWhisper::isJournaled(const AudioQueItem & item) {
+    // batch jobs have their own output. long files are the user's files.
+    return journal && item.journalId == 0 && !item.batchJob && !item.longFileJob && !item.longFile && !item.speculative;
+}
+
+void ofxWhisper::addToJournal(AudioQueItem & item) {
+    auto journal = this->journal;
+    if (!journal || !isJournaled(item)) return;
+    
+    ofJson meta;
+    string data;
+    meta["sourceId"] = item.sourceId;
+    meta["prompt"] = item.prompt;
+    if (item.buffer.size() > 0) {
+        auto format = ofxWhisperEncoder::isAvailable(ofxWhisperEncoder::Flac) ? ofxWhisperEncoder::Flac : ofxWhisperEncoder::Wav;
+        if (!ofxWhisperEncoder::encode(item.buffer, format, data)) return;
+        meta["ext"] = ofxWhisperEncoder::getExtension(format);
+    } else if (item.recorded) {
+        // the recorded file is in the temp directory, which is deleted on exit
+        std::ifstream file(item.filePath, std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        if (data.empty()) return;
+        meta["ext"] = ofFilePath::getFileExt(item.filePath);
+    } else {
+        meta["file"] = item.filePath;
+    }
+    item.journalId = journal->add(meta, data);
+}
+
+void ofxWhisper::processJournalWrites(ofThread & worker) {
+    while (true) {
+        AudioQueItem item;
+        {
+            std::unique_lock<ofMutex> lock(journalMutex);
+            journalCondition.wait_for(lock, std::chrono::milliseconds(100), [this] {
+                return !journalWrites.empty();
+            });
+            if (journalWrites.empty()) {
+                if (!worker.isThreadRunning()) break;
+                continue;
+            }
+            item = std::move(journalWrites.front());
+            journalWrites.pop_front();
+        }
+        addToJournal(item);
         
-    // we register the recorder end event
-    recordingEndListener = recorder.recordingEndEvent.newListener(this, &ofxWhisper::recordingEndCallback);
+        // on exit the items are only written. they are replayed next time.
+        if (worker.isThreadRunning()) queueItem(std::move(item));
+    }
 }
 
-void ofxWhisper::startRecording() {
-    if (!recording) {
-        ofLogNotice("ofxWhisper") << "Start recording";
-        recording = true;
-        recorder.startRecording(getTempPath() + "recording_" + ofGetTimestampString() + ".wav", true);
-        validBfferCount = 0;
+bool ofxWhisper::finishJournalItem(const AudioQueItem & item, bool success, const ofxWhisperResult & result) {
+    auto journal = this->journal;
+    if (!journal) return false;
+    if (success) {
+        // connection is back
+        journalMutex.lock();
+        journalBackoff = 1;
+        journalMutex.unlock();
+    }
+    if (item.journalId == 0) return false;
+    
+    // replayed audio is written again when it is sent next time
+    if (item.recorded && ofIsStringInString(item.filePath, journal->getDirectory())) {
+        ofFile::removeFile(item.filePath, false);
+    }
+    
+    if (!success && isRetryable(result)) {
+        JournalEntry entry;
+        entry.id = item.journalId;
+        entry.attempts = item.journalAttempts + 1;
+        if (entry.attempts < journalMaxAttempts) {
+            // e.g. network is down. keep it for later.
+            journalMutex.lock();
+            journalParked.push_back(entry);
+            journalBackoff = MIN(journalBackoff * 2, 64);
+            journalMutex.unlock();
+            return true;
+        }
+        ofLogError("ofxWhisper") << "Journal item " << entry.id << " failed " << entry.attempts << " times. Moved to " << journal->getDeadLetterDirectory();
+        if (journal->moveToDeadLetter(entry.id)) return false;
     }
+    journal->markDone(item.journalId);
+    return false;
 }
 
-void ofxWhisper::stopRecording() {
-    if (recording) {
-        ofLogNotice("ofxWhisper") << "Stop recording";
-        recorder.stopRecording();
+void ofxWhisper::drainJournal() {
+    uint64_t now = ofGetElapsedTimeMillis();
+    auto journal = this->journal;
+    if (!journal || !backend || now < nextJournalDrainTime) return;
+    
+    // one of the workers sends one item
+    std::unique_lock<ofMutex> lock(journalMutex, std::try_to_lock);
+    if (!lock.owns_lock() || now < nextJournalDrainTime || journalParked.empty()) return;
+    nextJournalDrainTime = now + journalDrainInterval * journalBackoff * 1000;
+    JournalEntry entry = journalParked.front();
+    journalParked.pop_front();
+    lock.unlock();
+    
+    ofJson meta;
+    string data;
+    if (!journal->read(entry.id, meta, data)) {
+        journal->markDone(entry.id);
+        return;
     }
+    AudioQueItem item;
+    item.journalId = entry.id;
+    item.replay = true;
+    item.journalAttempts = entry.attempts;
+    item.queuedTime = now;
+    item.sourceId = meta.value("sourceId", -1);
+    // journals of older versions have no prompt
+    item.prompt = meta.count("prompt") ? meta.value("prompt", "") : getContextPrompt();
+    if (data.size() > 0) {
+        item.filePath = ofFilePath::join(journal->getDirectory(), "replay_" + ofToString(entry.id) + "." + meta.value("ext", "wav"));
+        item.recorded = true;
+        bool written;
+        {
+            std::ofstream file(item.filePath, std::ios::binary | std::ios::trunc);
+            file.write(data.data(), data.size());
+            written = (bool)file;
+        }
+        if (!written) {
+            ofLogError("ofxWhisper") << "Cannot write " << item.filePath;
+            journalMutex.lock();
+            journalParked.push_back(entry);
+            journalMutex.unlock();
+            return;
+        }
+    } else {
+        item.filePath = meta.value("file", "");
+    }
+    ofLogNotice("ofxWhisper") << "Send journal item " << entry.id << " again";
+    // a new place in the order, so it does not hold back the live transcripts
+    audioQueMutex.lock();
+    item.sequence = nextSequence++;
+    audioQueMutex.unlock();
+    queueItem(std::move(item));
 }
 
-void ofxWhisper::startRealtimeRecording() {
-    if (realtimeRecording) return;
-    realtimeRecording = true;
-    ofLogNotice("ofxWhisper") << "Start Realtime Recording";
-    rrSilenceCount = 0;
+void ofxWhisper::setCache(shared_ptr<ofxWhisperCache> _cache) {
+    cache = _cache;
 }
 
-void ofxWhisper::stopRealtimeRecording() {
-    if (!realtimeRecording) return;
-    if (recording) stopRecording();
-    realtimeRecording = false;
-    ofLogNotice("ofxWhisper") << "Stop Realtime Recording";
+shared_ptr<ofxWhisperCache> ofxWhisper::getCache() {
+    return cache;
 }
 
-// rrStartThresholdのgetterとsetterの実装
-float ofxWhisper::getRrStartThreshold() const {
-    return rrStartThreshold;
+void ofxWhisper::deliverTranscript(uint64_t sequence, bool success, TranscriptResult && result) {
+    {
+        transcriptMutex.lock();
+        finishedItems[sequence] = FinishedItem{success, std::move(result)};
+        
+        // keep capture order. failed items just advance the sequence.
+        uint64_t now = ofGetElapsedTimeMillis();
+        auto it = finishedItems.begin();
+        while (it != finishedItems.end() && it->first == nextDeliverSequence) {
+            auto & r = it->second.result;
+            if (it->second.success) {
+                r.latency = now - (r.captureEndTime > 0 ? r.captureEndTime : r.queuedTime);
+                stats.latency.record(r.latency);
+                addToContext(r.text);
+                
+                // the app is not reading. drop the oldest transcript.
+                TranscriptResult copy = r;
+                while (!transcripts.tryPush(std::move(copy))) {
+                    TranscriptResult oldest;
+                    if (transcripts.tryPop(oldest)) stats.numTranscriptsDropped++;
+                }
+            } else if (r.errorCode == Success) {
+                r.errorCode = UnknownError;
+            }
+            queueCompletion(it->first, r);
+            if (it->second.success) {
+                std::lock_guard<ofMutex> lock(deliverMutex);
+                transcriptEventQueue.push_back(std::move(r));
+            }
+            it = finishedItems.erase(it);
+            nextDeliverSequence++;
+        }
+        transcriptMutex.unlock();
+    }
+    
+    // without lock, so the listeners and callbacks can call transcript() or cancel()
+    notifyTranscripts();
+    runCompletions();
 }
 
-void ofxWhisper::setRrStartThreshold(float value) {
-    rrStartThreshold = MIN(MAX(value, 0), 1.);
+void ofxWhisper::notifyTranscripts() {
+    std::unique_lock<ofMutex> lock(deliverMutex);
+    // the thread notifying them (or a listener calling back) takes the new ones too
+    if (notifyingTranscripts) return;
+    notifyingTranscripts = true;
+    while (!transcriptEventQueue.empty()) {
+        TranscriptResult r = std::move(transcriptEventQueue.front());
+        transcriptEventQueue.pop_front();
+        lock.unlock();
+        try {
+            ofNotifyEvent(transcriptEvents, r);
+        } catch (std::exception & e) {
+            ofLogError("ofxWhisper") << "Transcript listener of " << r.id << ": " << e.what();
+        } catch (...) {
+            ofLogError("ofxWhisper") << "Transcript listener of " << r.id << ": unknown exception";
+        }
+        lock.lock();
+    }
+    notifyingTranscripts = false;
 }
 
-// rrEndThresholdのgetterとsetterの実装
-float ofxWhisper::getRrEndThreshold() const {
-    return rrEndThreshold;
+void ofxWhisper::queueCompletion(uint64_t sequence, const TranscriptResult & result) {
+    std::lock_guard<ofMutex> lock(completionMutex);
+    auto it = completions.find(sequence);
+    if (it == completions.end()) return;
+    it->second->result = result;
+    workerCompletions.push_back(it->second);
+    completions.erase(it);
 }
 
-void ofxWhisper::setRrEndThreshold(float value) {
-    rrEndThreshold = MIN(MAX(value, 0), 1.);
+void ofxWhisper::runCompletions() {
+    std::unique_lock<ofMutex> lock(completionMutex);
+    // the thread running them (or a callback calling back) takes the new ones too
+    if (runningCompletions || workerCompletions.empty()) return;
+    runningCompletions = true;
+    while (!workerCompletions.empty()) {
+        auto completion = workerCompletions.front();
+        workerCompletions.pop_front();
+        lock.unlock();
+        
+        completion->promise.set_value(completion->result);
+        
+        lock.lock();
+        if (completion->callback && completion->executor == WorkerThread) {
+            threadCompletions.push_back(completion);
+            completionCondition.notify_one();
+        } else if (completion->callback && completion->executor == MainThread) {
+            mainThreadCompletions.push_back(completion);
+            hasMainThreadCompletions = true;
+        }
+    }
+    runningCompletions = false;
 }
 
-// rrSilenceTimeMaxのgetterとsetterの実装
-float ofxWhisper::getRrSilenceTimeMax() const {
-    return rrSilenceTimeMax;
+void ofxWhisper::processThreadCompletions(ofThread & worker) {
+    while (true) {
+        shared_ptr<Completion> completion;
+        {
+            std::unique_lock<ofMutex> lock(completionMutex);
+            completionCondition.wait_for(lock, std::chrono::milliseconds(100), [this] {
+                return !threadCompletions.empty();
+            });
+            if (threadCompletions.empty()) {
+                if (!worker.isThreadRunning()) break;
+                continue;
+            }
+            completion = threadCompletions.front();
+            threadCompletions.pop_front();
+        }
+        runCompletionCallback(*completion);
+    }
 }
 
-void ofxWhisper::setRrSilenceTimeMax(float value) {
-    rrSilenceTimeMax = MAX(0, value);
-    rrSilenceCoutMax = rrSilenceTimeMax * stream.getSampleRate() / stream.getBufferSize();
+void ofxWhisper::runMainThreadCompletions() {
+    // no lock while idle
+    if (!hasMainThreadCompletions) return;
+    deque<shared_ptr<Completion>> ready;
+    completionMutex.lock();
+    ready.swap(mainThreadCompletions);
+    hasMainThreadCompletions = false;
+    completionMutex.unlock();
+    
+    for (auto & completion : ready) {
+        runCompletionCallback(*completion);
+    }
 }
 
-void ofxWhisper::transcript(string file) {
-    audioQueMutex.lock();
-    audioQue.push_back(file);
-    audioQueMutex.unlock();
-    if (!isThreadRunning()) startThread();
+void ofxWhisper::runCompletionCallback(Completion & completion) {
+    // an exception in one callback does not stop the others
+    try {
+        completion.callback(completion.result);
+    } catch (std::exception & e) {
+        ofLogError("ofxWhisper") << "Completion callback of " << completion.result.id << ": " << e.what();
+    } catch (...) {
+        ofLogError("ofxWhisper") << "Completion callback of " << completion.result.id << ": unknown exception";
+    }
 }
 
-void ofxWhisper::setPrompt(string _prompt) {
-    prompt = _prompt;
+ofxWhisper::TranscriptResult ofxWhisper::makeTranscriptResult(const AudioQueItem & item, const ofxWhisperResult & result, uint64_t requestStartTime) {
+    TranscriptResult r;
+    r.id = item.sequence;
+    r.sourceId = item.sourceId;
+    r.filePath = item.filePath;
+    r.captureStartTime = item.captureStartTime;
+    r.captureEndTime = item.captureEndTime;
+    r.text = result.text;
+    r.language = result.language != "" ? result.language : language;
+    r.duration = result.duration;
+    r.segments = result.segments;
+    r.words = result.words;
+    r.confidence = getConfidence(r.segments);
+    r.queuedTime = item.queuedTime;
+    r.queueTime = requestStartTime - item.queuedTime;
+    r.requestTime = ofGetElapsedTimeMillis() - requestStartTime;
+    r.serverTime = result.serverTime;
+    r.attempts = item.attempts + 1;
+    r.fromCache = result.fromCache;
+    r.errorCode = result.errorCode;
+    return r;
 }
 
-string ofxWhisper::getPrompt() {
-    return prompt;
+float ofxWhisper::getConfidence(const vector<TranscriptSegment> & segments) {
+    // weighted by segment length
+    float sum = 0, weight = 0;
+    for (auto & segment : segments) {
+        if (segment.confidence < 0) continue;
+        float w = MAX(0.01, segment.end - segment.start);
+        sum += segment.confidence * w;
+        weight += w;
+    }
+    return weight > 0 ? sum / weight : -1;
 }
 
-void ofxWhisper::setLanguage(string _language) {
-    language = _language;
+void ofxWhisper::setStreaming(bool enabled, float stepTime, float windowTime) {
+    streamingStepTime = MAX(0.1, stepTime);
+    streamingWindowTime = MAX(streamingStepTime, windowTime);
+    if (enabled == streaming) return;
+    
+    streaming = enabled;
+    if (streaming) {
+        ofLogNotice("ofxWhisper") << "Start streaming";
+        streamingWorker.startThread();
+    } else {
+        ofLogNotice("ofxWhisper") << "Stop streaming";
+        streamingWorker.waitForThread(true);
+        streamingMutex.lock();
+        streamingBuffer.clear();
+        streamingMutex.unlock();
+    }
 }
 
-string ofxWhisper::getLanguage() {
-    return language;
+bool ofxWhisper::isStreaming() const {
+    return streaming;
 }
 
-void ofxWhisper::threadedFunction() {
-    while (isThreadRunning()) {
-        bool hasData = false;
-        string soundFilePath = "";
-        ofxSoundFile soundFile;
-        ofSoundBuffer buffer;
-        audioQueMutex.lock();
-        if (!audioQue.empty()) {
-            soundFilePath = audioQue.front();
-            audioQue.erase(audioQue.begin());
+void ofxWhisper::processStreaming(ofThread & worker) {
+    while (worker.isThreadRunning()) {
+        uint64_t startTime = ofGetElapsedTimeMillis();
+        bool segmentEnded = streamingSegmentEnded.exchange(false);
+        bool windowFull = false;
+        
+        ofxWhisperBackend::Request request;
+        streamingMutex.lock();
+        request.buffer = streamingBuffer;
+        if (segmentEnded) {
+            streamingBuffer.clear();
         }
-        audioQueMutex.unlock();
-
-        if (soundFilePath != "") {
-            int tryCount = 0;
-            while (!ofFile(soundFilePath).exists()) {
-                if (tryCount++ == 10) break;
-                ofSleepMillis(100);
-            }
-            
-            if (ofFile(soundFilePath).exists()) {
-                hasData = true;
-            } else {
-                ofLogError("ofxWhisper") << "Data " << soundFilePath << " is not exists.";
-            }
+        else if (streamingBuffer.getDurationMS() >= streamingWindowTime * 1000) {
+            // slide the window. keep a little audio for the next word onset.
+            windowFull = true;
+            size_t numChannels = streamingBuffer.getNumChannels();
+            size_t keepFrames = MIN(streamingBuffer.getNumFrames(), (size_t)(streamingBuffer.getSampleRate() * 0.2));
+            auto & samples = streamingBuffer.getBuffer();
+            ofSoundBuffer kept;
+            kept.copyFrom(samples.data() + samples.size() - keepFrames * numChannels, keepFrames, numChannels, streamingBuffer.getSampleRate());
+            streamingBuffer.swap(kept);
         }
-
-        if (hasData) {
-            ofxHttpForm form;
-            form.action = "https://api.openai.com/v1/audio/transcriptions";
-            form.method = OFX_HTTP_POST;
-            form.addHeaderField("Authorization", "Bearer " + apiKey);
-            form.addHeaderField("Content-Type", "multipart/form-data");
-            form.addFile("file", soundFilePath);
-            form.addFormField("model", "whisper-1");
-            if (prompt != "") {
-                form.addFormField("prompt", prompt);
-            }
-            if (language != "") {
-                form.addFormField("language", language);
+        streamingMutex.unlock();
+        
+        if (backend && request.buffer.size() > 0) {
+            // committed text is context for the rest of the utterance
+            request.prompt = getPrompt();
+            if (streamingCommitted.size() > 0) {
+                size_t contextSize = MIN(streamingCommitted.size(), (size_t)200);
+                request.prompt += " " + streamingCommitted.substr(streamingCommitted.size() - contextSize);
             }
-            ofxHttpResponse response = httpUtils.submitForm(form);
-            
-            auto errorCode = parseErrorResponse(response);
-                                    
-            if (errorCode == Success) {
-                string rawText = response.responseBody.getText();
-                ofJson res = ofJson::parse(rawText);
-                try {
-                    string transcript = res["text"];
-                    ofLogVerbose("ofxWhisper") << "Got transcript: " << transcript;
-                    transcriptMutex.lock();
-                    transcripts.push_back(transcript);
-                    transcriptMutex.unlock();
-                }
-                catch (exception e) {
-                    ofLogError("ofxWhisper") << "JOSN parse error";
-                }
+            request.language = language;
+            auto result = backend->transcribe(request);
+            if (result.errorCode == Success) {
+                updatePartialTranscript(result.text, segmentEnded, windowFull);
             } else {
-                ofLogError("ofxWhisper") << getErrorMessage(errorCode);
-                ofLogVerbose("ofxWhisper") << "Data: " << response.responseBody.getText();
+                ofLogVerbose("ofxWhisper") << "Streaming: " << getErrorMessage(result.errorCode);
             }
-        } else {
-            // thread end
-            break;
         }
+        
+        uint64_t elapsed = ofGetElapsedTimeMillis() - startTime;
+        uint64_t step = streamingStepTime * 1000;
+        if (elapsed < step && !streamingSegmentEnded) {
+            ofSleepMillis(step - elapsed);
+        }
+    }
+}
+
+void ofxWhisper::updatePartialTranscript(const string & hypothesis, bool isFinal, bool windowFull) {
+    auto words = ofSplitString(hypothesis, " ", true, true);
+    
+    // words agreed by two consecutive hypotheses are stable
+    size_t stable = 0;
+    while (stable < words.size() && stable < streamingPrevWords.size() && words[stable] == streamingPrevWords[stable]) {
+        stable++;
+    }
+    if (isFinal || windowFull) stable = words.size();
+    
+    for (size_t i = streamingWindowCommitted; i < stable; ++i) {
+        if (streamingCommitted.size() > 0) streamingCommitted += " ";
+        streamingCommitted += words[i];
+    }
+    streamingWindowCommitted = MAX(streamingWindowCommitted, stable);
+    
+    PartialTranscriptEventArgs args;
+    args.committed = streamingCommitted;
+    for (size_t i = streamingWindowCommitted; i < words.size(); ++i) {
+        if (args.provisional.size() > 0) args.provisional += " ";
+        args.provisional += words[i];
+    }
+    args.isFinal = isFinal;
+    ofNotifyEvent(partialTranscriptEvents, args);
+    
+    if (isFinal) {
+        streamingCommitted = "";
+    }
+    if (isFinal || windowFull) {
+        streamingPrevWords.clear();
+        streamingWindowCommitted = 0;
+    } else {
+        streamingPrevWords = words;
     }
 }
 
 bool ofxWhisper::hasTranscript() {
-    transcriptMutex.lock();
-    bool has_transcript = !transcripts.empty();
-    transcriptMutex.unlock();
-    return has_transcript;
+    return !transcripts.empty();
 }
 
 int ofxWhisper::numTranscripts() {
-    audioQueMutex.lock();
-    int num_transcripts = (int)transcripts.size();
-    audioQueMutex.unlock();
-    return num_transcripts;
+    return (int)transcripts.size();
 }
 
 string ofxWhisper::getNextTranscript() {
-    string transcript;
-    transcriptMutex.lock();
-    if (!transcripts.empty()) {
-        transcript = transcripts.front();
-        transcripts.erase(transcripts.begin());
-    }
-    transcriptMutex.unlock();
-    return transcript;
+    return getNextResult().text;
+}
+
+ofxWhisper::TranscriptResult ofxWhisper::getNextResult() {
+    TranscriptResult result;
+    transcripts.tryPop(result);
+    return result;
 }
 
 bool ofxWhisper::isRecording() {
-    return recording;
+    return isRecording(0);
+}
+
+bool ofxWhisper::isRecording(int sourceId) {
+    auto source = getSource(sourceId);
+    return source && source->recording;
 }
 
 float ofxWhisper::getAudioLevel() {
-    return audioLevel;
+    return getAudioLevel(0);
+}
+
+float ofxWhisper::getAudioLevel(int sourceId) {
+    auto source = getSource(sourceId);
+    return source ? source->audioLevel : 0;
 }
 
 void ofxWhisper::audioIn(ofSoundBuffer &input) {
+    audioIn(0, input);
+}
+
+void ofxWhisper::audioIn(int sourceId, ofSoundBuffer &input) {
+    // audio thread: only copy samples. everything else runs in processCapture()
+    auto source = getSource(sourceId);
+    if (!source) return;
+    
+    // announce the write before checking configured (both seq_cst), so configureSource()
+    // either sees this writer or this call sees configured == false
+    source->writers++;
+    if (!source->configured) {
+        source->writers--;
+        return;
+    }
+    
+    uint64_t startTime = ofGetElapsedTimeMicros();
+    auto & samples = input.getBuffer();
+    size_t written = source->ring.write(samples.data(), samples.size());
+    source->writers--;
+    if (written < samples.size()) {
+        source->droppedSamples += samples.size() - written;
+        stats.numOverruns++;
+        stats.droppedSamples += samples.size() - written;
+    }
+    stats.audioCallback.record((ofGetElapsedTimeMicros() - startTime) * 0.001);
+}
+
+void ofxWhisper::DeviceInput::audioIn(ofSoundBuffer & input) {
+    // route channels of the device to the sources
+    size_t numFrames = input.getNumFrames();
+    size_t numChannels = input.getNumChannels();
+    for (auto & route : routes) {
+        if (route.second < 0 || numChannels == 1) {
+            owner.audioIn(route.first, input);
+            continue;
+        }
+        if (channelBuffer.getNumFrames() != numFrames) {
+            channelBuffer.allocate(numFrames, 1);
+            channelBuffer.setSampleRate(input.getSampleRate());
+        }
+        const float * src = input.getBuffer().data() + route.second;
+        float * dst = channelBuffer.getBuffer().data();
+        for (size_t i = 0; i < numFrames; ++i) {
+            dst[i] = src[i * numChannels];
+        }
+        owner.audioIn(route.first, channelBuffer);
+    }
+}
+
+void ofxWhisper::processCapture(ofThread & worker) {
+    // preallocated blocks. no allocation while reading the ring buffers
+    vector<ofSoundBuffer> blocks(numSources);
+    vector<uint64_t> droppedReported(numSources, 0);
+    for (int i = 0; i < numSources; ++i) {
+        auto & source = *sources[i];
+        blocks[i].allocate(source.bufferSize, source.numChannels);
+        blocks[i].setSampleRate(source.sampleRate);
+    }
+    
+    // one thread for all sources
+    while (worker.isThreadRunning()) {
+        bool processed = false;
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            auto & source = *sources[i];
+            size_t blockSize = source.bufferSize * source.numChannels;
+            if (!source.configured || source.ring.getNumReadable() < blockSize) continue;
+            
+            // read into a pool block, so it can be shared with the subscribers without copy
+            ofxWhisperAudioBlockRef block;
+            bool publish = numAudioSubscriptions > 0;
+            if (publish) {
+                block = source.audioPool.acquire();
+                if (!block) stats.numAudioBlocksDropped++;
+            }
+            ofSoundBuffer & buffer = block ? block.getMutable()->buffer : blocks[i];
+            source.ring.read(buffer.getBuffer().data(), blockSize);
+            uint64_t startTime = ofGetElapsedTimeMicros();
+            processCapturedBuffer(source, buffer);
+            stats.capture.record((ofGetElapsedTimeMicros() - startTime) * 0.001);
+            processed = true;
+            
+            if (block) {
+                auto b = block.getMutable();
+                b->sourceId = source.id;
+                b->frameIndex = source.capturedFrames;
+                b->time = ofGetElapsedTimeMillis();
+                publishAudioBlock(block);
+            }
+            source.capturedFrames += source.bufferSize;
+            
+            uint64_t dropped = source.droppedSamples;
+            if (dropped != droppedReported[i]) {
+                ofLogWarning("ofxWhisper") << "Capture buffer overflow. " << dropped - droppedReported[i] << " samples dropped (source " << i << ")";
+                droppedReported[i] = dropped;
+            }
+        }
+        if (!processed) ofSleepMillis(1);
+    }
+}
+
+void ofxWhisper::publishAudioBlock(const ofxWhisperAudioBlockRef & block) {
+    shared_ptr<const vector<AudioSubscription>> subscriptions;
+    {
+        std::lock_guard<ofMutex> lock(audioSubscriptionMutex);
+        subscriptions = audioSubscriptions;
+    }
+    if (!subscriptions) return;
+    for (auto & s : *subscriptions) {
+        if (s.sourceId < 0 || s.sourceId == block->getSourceId()) s.callback(block);
+    }
+}
+
+void ofxWhisper::processCapturedBuffer(CaptureSource & source, ofSoundBuffer &input) {
+    auto & samples = input.getBuffer();
+    if (dcRemoval) {
+        // the offset follows in about 1 sec
+        float k = ofClamp((float)input.getNumFrames() / MAX(1, source.sampleRate), 0, 1);
+        ofxWhisperDsp::removeDc(samples.data(), input.getNumFrames(), source.numChannels, source.dcOffsets.data(), k);
+    }
+    
     // calc volume
-    audioLevel = 0;
-    for (auto &s : input.getBuffer()) {
-        audioLevel = MAX(audioLevel, abs(s));
+    float audioLevel = ofxWhisperDsp::peak(samples.data(), samples.size());
+    source.audioLevel = audioLevel;
+    
+    // speech detection. peak level thresholds or VAD
+    bool aboveStart, aboveEnd;
+    source.vadMutex.lock();
+    if (source.vad) {
+        source.speechProbability = source.vad->process(input);
+        aboveStart = source.speechProbability >= vadStartThreshold;
+        aboveEnd = source.speechProbability >= vadEndThreshold;
+    } else {
+        source.speechProbability = audioLevel >= source.rrStartThreshold ? 1 : 0;
+        aboveStart = audioLevel >= source.rrStartThreshold;
+        aboveEnd = audioLevel >= source.rrEndThreshold;
     }
+    source.vadMutex.unlock();
     
     // increment valid count
-    if (audioLevel >= rrStartThreshold) validBfferCount++;
+    if (aboveStart) source.validBfferCount++;
     
     // realtime recording control
     if (realtimeRecording) {
         // Check start
-        if (!recorder.isRecording()) {
-            if (audioLevel >= rrStartThreshold) {
-                rrSilenceCount = 0;
-                startRecording();
+        if (!isCapturing(source)) {
+            if (aboveStart) {
+                source.rrSilenceCount = 0;
+                source.postRollRemaining = 0;
+                source.hasSpeculative = false;
+                startRecording(source.id);
                 
-                // append past buffer history
-                for (auto history : audioBufferHistory) {
-                    recorder.process(history, history);
+                // pre-roll in one block
+                size_t numSamples = source.preRoll.getSize();
+                if (numSamples > 0) {
+                    source.preRollBlock.resize(numSamples);
+                    source.preRoll.copyTo(source.preRollBlock.getBuffer().data());
+                    appendToRecording(source, source.preRollBlock);
                 }
             }
         }
         
+        // Post-roll after the end of speech
+        else if (source.postRollRemaining > 0) {
+            if (aboveEnd) {
+                source.postRollRemaining = 0;
+                source.rrSilenceCount = 0;
+                resolveSpeculativeUpload(source, false);
+            } else if (source.postRollRemaining <= input.getNumFrames()) {
+                source.postRollRemaining = 0;
+                stopRecording(source.id);
+            } else {
+                source.postRollRemaining -= input.getNumFrames();
+            }
+        }
+        
         // Check end
         else {
-            if (audioLevel < rrEndThreshold) {
-                rrSilenceCount++;
-                if (rrSilenceCount >= rrSilenceCoutMax) {
-                    stopRecording();
+            if (!aboveEnd) {
+                source.rrSilenceCount++;
+                if (speculativeUpload && source.rrSilenceCount == 1) {
+                    startSpeculativeUpload(source);
+                }
+                if (source.rrSilenceCount >= source.rrSilenceCoutMax) {
+                    stats.silenceWait.record(source.rrSilenceCount * 1000. * input.getNumFrames() / MAX(1, source.sampleRate));
+                    source.postRollRemaining = postRollTime * source.sampleRate / 1000;
+                    if (source.postRollRemaining == 0) stopRecording(source.id);
                 }
             }
             else {
-                rrSilenceCount = 0;
+                // speech again. the segment goes on.
+                source.rrSilenceCount = 0;
+                resolveSpeculativeUpload(source, false);
             }
         }
     }
     
-    if (recorder.isRecording()) {
-        recorder.process(input, input);
+    if (isCapturing(source)) {
+        appendToRecording(source, input);
     }
     
-    audioBufferHistory.push_back(input);
-    if (audioBufferHistory.size() >= audioBufferHistoryMax) {
-        audioBufferHistory.erase(audioBufferHistory.begin());
-    }
+    source.preRoll.write(input.getBuffer().data(), input.getBuffer().size());
     
     // event
     AudioEventArgs args;
+    args.sourceId = source.id;
     args.audioLevel = audioLevel;
-    args.isRecording = isRecording();
+    args.speechProbability = source.speechProbability;
+    args.isRecording = source.recording;
     ofNotifyEvent(audioEvents, args);
 }
 
+void ofxWhisper::appendToRecording(CaptureSource & source, ofSoundBuffer & buffer) {
+    source.recordingFrames += buffer.getNumFrames();
+    if (inMemoryRecording) {
+        source.recordingBufferMutex.lock();
+        source.recordingBuffer.append(buffer);
+        source.recordingBufferMutex.unlock();
+    } else {
+        source.recorder.process(buffer, buffer);
+    }
+    
+    // streaming partials are for the default source only
+    if (streaming && source.id == 0) {
+        streamingMutex.lock();
+        if (streamingBuffer.size() == 0) {
+            streamingBuffer = buffer;
+        } else {
+            streamingBuffer.append(buffer);
+        }
+        streamingMutex.unlock();
+    }
+}
+
 // Helper function to parse the error response and return the appropriate error code.
 ofxWhisper::ErrorCode ofxWhisper::parseErrorResponse(const ofxHttpResponse& response) {
     int status = response.status;
     if (status == 200) {
         return Success;
     }
+    else if (status <= 0) {
+        return NetworkError;
+    }
     else if (status == 401) {
         return InvalidAPIKey;
     } else if (status >= 500 && status < 600) {
@@ -342,29 +2366,79 @@ string ofxWhisper::getErrorMessage(ofxWhisper::ErrorCode errorCode) {
             return "Bad request";
         case Timeout:
             return "Timeout";
+        case Cancelled:
+            return "Cancelled";
         default:
             return "Unknown error";
     }
 }
 
-void ofxWhisper::recordingEndCallback(string &filePath) {
+void ofxWhisper::recordingEndCallback(int sourceId, string &filePath) {
+    auto source = getSource(sourceId);
+    if (!source) return;
     ofLogNotice("ofxWhisper") << "Recording end. " << filePath;
-    ofLogNotice("ofxWhisper") << "Count: " << validBfferCount;
-    if (validBfferCount >= validBfferCountThreshold) {
-        transcript(filePath);
+    stats.wavFinalize.record(ofGetElapsedTimeMillis() - source->recordingEndTime);
+    segmentStore.commit(filePath);
+    if (segmentStore.isOverBudget()) evictQueuedSegments();
+    AudioQueItem item;
+    item.filePath = filePath;
+    item.recorded = true;
+    finishRecording(*source, std::move(item));
+}
+
+void ofxWhisper::finishRecording(CaptureSource & source, AudioQueItem && item) {
+    item.sourceId = source.id;
+    item.captureStartTime = source.recordingStartTime;
+    item.captureEndTime = source.recordingEndTime;
+    
+    if (source.hasSpeculative) {
+        uint64_t silenceFrames = (uint64_t)source.rrSilenceCoutMax * source.bufferSize;
+        if (source.recordingFrames > source.speculativeFrames + silenceFrames) {
+            // post-roll recorded audio after the cut, which is not in the speculative upload.
+            // the full recording is sent instead.
+            resolveSpeculativeUpload(source, false);
+        } else {
+            // no speech after the speculative upload. its transcript is the one of this recording.
+            resolveSpeculativeUpload(source, true, &item);
+            source.recording = false;
+            return;
+        }
+    }
+    
+    ofLogNotice("ofxWhisper") << "Count: " << source.validBfferCount;
+    if (source.validBfferCount >= validBfferCountThreshold) {
+        addToAudioQue(std::move(item));
     }else{
         ofLogWarning("ofxWhisper") << "The audio is too short to transcribe.";
+        if (item.recorded) segmentStore.release(item.filePath);
+    }
+    source.recording = false;
+}
+
+void ofxWhisper::evictQueuedSegments() {
+    while (segmentStore.isOverBudget()) {
+        AudioQueItem item;
+        {
+            std::lock_guard<ofMutex> lock(audioQueMutex);
+            auto oldest = std::find_if(audioQue.begin(), audioQue.end(), [this](const AudioQueItem & i) {
+                return i.recorded && segmentStore.contains(i.filePath);
+            });
+            if (oldest == audioQue.end()) return;
+            if (isQueueCounted(*oldest)) numQueuedItems--;
+            item = std::move(*oldest);
+            audioQue.erase(oldest);
+            stats.queueDepth.record(audioQue.size());
+        }
+        audioQueSpaceCondition.notify_all();
+        stats.numQueueDropped++;
+        numDropped++;
+        
+        segmentStore.evict(item.filePath);
+        finishJournalItem(item, false, ofxWhisperResult());
+        deliverTranscript(item.sequence, false, makeTranscriptResult(item, ofxWhisperResult(), item.queuedTime));
     }
-    recording = false;
 }
 
 string ofxWhisper::getTempPath() {
-   char tempPath[PATH_MAX];
-   size_t tempPathSize = confstr(_CS_DARWIN_USER_TEMP_DIR, tempPath, sizeof(tempPath));
-   
-   if (tempPathSize == 0 || tempPathSize > sizeof(tempPath)) {
-       return "";
-   }
-   
-   return ofToDataPath(string(tempPath) + "ofxWhisper/");
+    return segmentStore.getDirectory();
 }
@@ -3,6 +3,20 @@
 #include "ofxSoundObjects.h"
 #include "waveformDraw.h"
 #include "ofxHttpUtils.h"
+#include "ofxWhisperRingBuffer.h"
+#include "ofxWhisperQueue.h"
+#include "ofxWhisperVad.h"
+#include "ofxWhisperEncoder.h"
+#include "ofxWhisperCache.h"
+#include "ofxWhisperStats.h"
+#include "ofxWhisperSegmentStore.h"
+#include "ofxWhisperAudioPool.h"
+#include "ofxWhisperDsp.h"
+
+class ofxWhisperBackend;
+struct ofxWhisperResult;
+class ofxWhisperBatchJob;
+class ofxWhisperJournal;
 
 class ofxWhisper : public ofThread , public ofBaseSoundInput {
 public:
@@ -20,11 +34,17 @@ public:
         InvalidModel,
         BadRequest,
         Timeout,
-        UnknownError
+        UnknownError,
+        // removed from the queue by cancel()
+        Cancelled
     };
 
+    // Setup with OpenAI Whisper API
     void setup(string api_key);
     
+    // Setup with any transcription backend (e.g. ofxWhisperLocalBackend)
+    void setup(shared_ptr<ofxWhisperBackend> _backend);
+    
     // Print devices
     void printSoundDevices();
     
@@ -34,11 +54,30 @@ public:
     // Set devide id
     void setupRecorder(int _soundDeviceID = 0);
     
+    // Setup capture without sound device. Feed audioIn() yourself.
+    // (setupRecorder() calls it)
+    void setupCapture(int sampleRate, int numChannels, int bufferSize = 256);
+    
+    // Multiple sources. All sources share the capture thread and the upload workers,
+    // and each of them has its own VAD state and recording. Transcripts have the source id.
+    // setupRecorder() / setupCapture() set up source 0.
+    // Add a sound device. channel: a channel of a multichannel device (-1: all channels)
+    // Return source id.
+    int addDeviceSource(int soundDeviceID, int channel = -1, string name = "");
+    
+    // Add a source fed with audioIn(sourceId, buffer) by the app. Return source id.
+    int addCaptureSource(int sampleRate, int numChannels, int bufferSize = 256, string name = "");
+    
+    int getNumSources() const;
+    string getSourceName(int sourceId);
+    
     // Start recording with Device ID (default:0)
     void startRecording();
+    void startRecording(int sourceId);
     
     // Stop recording and add recordingBuffer to audioQue
     void stopRecording();
+    void stopRecording(int sourceId);
     
     // Start realtime recording (recording continuously)
     void startRealtimeRecording();
@@ -46,105 +85,875 @@ public:
     // Stop realtime recording
     void stopRealtimeRecording();
     
-    // rrStartThresholdのgetterとsetter
+    // rrStartThresholdのgetterとsetter (all sources)
     float getRrStartThreshold() const;
     void setRrStartThreshold(float value);
 
-    // rrEndThresholdのgetterとsetter
+    // rrEndThresholdのgetterとsetter (all sources)
     float getRrEndThreshold() const;
     void setRrEndThreshold(float value);
+    
+    // Thresholds of a source
+    void setRrThresholds(int sourceId, float start, float end);
 
     // rrSilenceTimeMaxのgetterとsetter
     float getRrSilenceTimeMax() const;
     void setRrSilenceTimeMax(float value);
     
+    // Audio before the start of speech added to the recording (ms, default:300)
+    void setPreRollTime(float ms);
+    float getPreRollTime() const;
+    
+    // Audio recorded after the silence of rrSilenceTimeMax (ms, default:0).
+    // Counted in frames, and rounded up to the capture block (bufferSize frames) it ends in.
+    // The recording goes on if speech starts again in this time.
+    void setPostRollTime(float ms);
+    float getPostRollTime() const;
+    
+    // Remove the DC offset of the captured audio (default:false), which raises the peak level
+    // of some cheap microphones. Applied before the VAD, the recording and the audio subscribers.
+    void setDcRemoval(bool enabled);
+    bool isDcRemoval() const;
+    
+    // Voice activity detector for realtime recording (e.g. ofxWhisperEnergyVad)
+    // If it is set, speech probability and vadStart/EndThreshold are used instead of rrStart/EndThreshold.
+    // nullptr: peak level thresholds (default)
+    void setVad(shared_ptr<ofxWhisperVad> _vad);
+    shared_ptr<ofxWhisperVad> getVad();
+    
+    // VAD of a source. VAD has a state, so don't share an instance between sources.
+    void setVad(int sourceId, shared_ptr<ofxWhisperVad> _vad);
+    shared_ptr<ofxWhisperVad> getVad(int sourceId);
+    
+    // vadStartThresholdのgetterとsetter (speech probability 0-1)
+    float getVadStartThreshold() const;
+    void setVadStartThreshold(float value);
+    
+    // vadEndThresholdのgetterとsetter (speech probability 0-1)
+    float getVadEndThreshold() const;
+    void setVadEndThreshold(float value);
+    
+    // Speech probability of the last captured block
+    float getSpeechProbability();
+    float getSpeechProbability(int sourceId);
+    
+    // Keep recorded audio in memory and upload it without writing a wav file
+    void setInMemoryRecording(bool enabled);
+    bool isInMemoryRecording() const;
+    
+    // Where recorded wav files are written (see ofxWhisperSegmentStore.h). Default: Disk in the system temp directory.
+    // Memory: RAM-backed tmpfs. If there is none (e.g. macOS, Windows), in-memory recording is used instead.
+    // maxBytes: budget of the files waiting for upload (0: unlimited). When it is exceeded the oldest
+    // queued recordings are dropped (they fail in order). Files of items in flight are kept.
+    bool setSegmentStorage(ofxWhisperSegmentStore::Type type, size_t maxBytes = 0, string directory = "");
+    ofxWhisperSegmentStore & getSegmentStore();
+    
+    // Speculative upload in realtime recording (needs in-memory recording, default:false).
+    // The segment is uploaded as soon as the level drops below the end threshold, while the
+    // silence timer (rrSilenceTimeMax) is running. If speech starts again the request is discarded
+    // and the longer segment is sent later. Costs extra requests, saves up to rrSilenceTimeMax of latency.
+    // If the request fails or the post-roll records audio after the cut, the full segment is sent.
+    void setSpeculativeUpload(bool enabled);
+    bool isSpeculativeUpload() const;
+    
+    // Streaming mode. While recording, the captured audio is transcribed every stepTime
+    // over a rolling window (windowTime) and partialTranscriptEvents is notified.
+    // Intended for fast backends like ofxWhisperLocalBackend.
+    // The whole segment is also transcribed as usual and returned by getNextTranscript().
+    void setStreaming(bool enabled, float stepTime = 0.5, float windowTime = 10.0);
+    bool isStreaming() const;
+    
+    // Completion of transcript(). The future of the handle is set and the callback is called
+    // with the result, also when it failed (see TranscriptResult::errorCode), in capture order.
+    // No need to poll getNextTranscript(), e.g. in a headless service.
+    // Exceptions thrown by callbacks are logged.
+    enum Executor {
+        WorkerThread, // right after the result, from the completion thread of ofxWhisper
+        MainThread,   // from ofEvents().update
+    };
+    struct TranscriptResult;
+    class TranscriptHandle;
+    typedef std::function<void(const TranscriptResult &)> CompletionCallback;
+    
     // Add audio file to audioQue
-    void transcript(string file);
+    TranscriptHandle transcript(string file, CompletionCallback callback = nullptr, Executor executor = WorkerThread);
+    
+    // Transcribe a long audio file (e.g. hour long recording).
+    // The file is decoded and split at quiet points into chunks (chunkTime sec) with small overlaps.
+    // Chunks are transcribed concurrently by the upload workers and the stitched text is
+    // returned by getNextTranscript(). Progress is notified with longFileEvents.
+    // Return the id of the file in longFileEvents.
+    uint64_t transcriptLongFile(string file, float chunkTime = 60, float overlapTime = 1.0);
+    
+    // Add audio buffer to audioQue (uploaded from memory)
+    TranscriptHandle transcript(const ofSoundBuffer & buffer, CompletionCallback callback = nullptr, Executor executor = WorkerThread);
+    
+    // Add interleaved float PCM to audioQue (uploaded from memory)
+    TranscriptHandle transcript(const float * samples, size_t numFrames, size_t numChannels, int sampleRate, CompletionCallback callback = nullptr, Executor executor = WorkerThread);
+    
+    // Remove a queued item (id of TranscriptHandle or TranscriptResult). Its result is Cancelled.
+    // Return false if it is not in the queue: in flight, finished, a chunk of a long file or
+    // a file of a batch job (see ofxWhisperBatchJob::cancel()).
+    bool cancel(uint64_t id);
+    
+    // Transcribe many files (see ofxWhisperBatch.h). At most maxConcurrent files of the job are
+    // queued or in flight. Results are not returned by getNextTranscript() but by the job.
+    // e.g. transcriptBatch(ofxWhisperBatchJob::findFiles("archive", "*.wav;*.mp3"), 8, "archive.jsonl")
+    shared_ptr<ofxWhisperBatchJob> transcriptBatch(const vector<string> & files, int maxConcurrent = 8, string jsonlPath = "", string srtDirectory = "");
     
     // Add prompt
     void setPrompt(string _prompt);
     
     string getPrompt();
     
+    // Automatic prompt context. Recent transcripts are added after the prompt of the next
+    // segment, so names and spelling carry over segment boundaries. The oldest text is dropped
+    // to keep the prompt in maxTokens (estimated. Whisper uses up to 224 prompt tokens).
+    // Batch jobs and long file chunks use the prompt only. The prompt is taken when the segment
+    // is queued, so segments sent concurrently don't see each other's transcripts.
+    void setAutoContext(bool enabled, int maxTokens = 224);
+    bool isAutoContext() const;
+    
+    // Prompt sent with the next segment (prompt + context)
+    string getContextPrompt();
+    void clearContext();
+    
     // set Language ISO 639-1 code
     // https://en.wikipedia.org/wiki/List_of_ISO_639-1_codes
     void setLanguage(string _language);
     
     string getLanguage();
     
+    // Downmix and resample to 16kHz mono before upload (default:true)
+    void setUploadResample(bool enabled);
+    bool isUploadResample() const;
+    
+    // Audio format of recorded audio for upload (default:Wav)
+    // Flac and Opus are much smaller. They need the encoder library (see ofxWhisperEncoder.h).
+    void setUploadFormat(ofxWhisperEncoder::Format format);
+    ofxWhisperEncoder::Format getUploadFormat() const;
+    
+    // Number of upload workers (default:1). This thread is the first worker.
+    void setNumWorkers(int num);
+    int getNumWorkers() const;
+    
+    // Max HTTP requests in flight at once (default:4)
+    void setMaxInFlight(int num);
+    int getMaxInFlight() const;
+    
+    // What to do when the upload queue is full
+    enum OverflowPolicy {
+        DropOldest,    // drop the oldest waiting item (default)
+        DropNewest,    // drop the new item
+        Block,         // wait for a free slot. the capture ring may overflow while waiting.
+                       // on an upload worker (transcriptEvents listener) the new item is dropped.
+        MergeAdjacent, // append the new audio to the last waiting item (in-memory audio only)
+    };
+    
+    // Max num of items waiting for upload (default:256, 0:unlimited).
+    // Chunks of a long file and retries are not counted.
+    void setMaxQueueSize(size_t num, OverflowPolicy policy = DropOldest);
+    size_t getMaxQueueSize() const;
+    OverflowPolicy getOverflowPolicy() const;
+    
+    // Num of items waiting for upload (not including requests in flight).
+    // The app can stop recording or lower the quality when it grows.
+    size_t getQueueSize();
+    
+    // Retry failed requests (rate limit, server error, timeout, network error)
+    // with jittered exponential backoff (default:5)
+    void setMaxRetries(int num);
+    int getMaxRetries() const;
+    
+    // Give up retrying an item after this time (sec, default:120)
+    void setRetryTimeMax(float sec);
+    float getRetryTimeMax() const;
+    
+    // Num of retried requests
+    int getNumRetried() const;
+    
+    // Num of items which could not be transcribed
+    int getNumDropped() const;
+    
+    // Stage timers (ms) and counters
+    ofxWhisperStats::Snapshot getStats() const;
+    void resetStats();
+    
+    // Write getStats() to file every interval (sec). "" to stop.
+    // e.g. "stats.json" or "ofxwhisper.prom" (Prometheus text)
+    void setStatsFile(string path, float interval = 10);
+    
+    // Write-ahead journal of queued audio (see ofxWhisperJournal.h), so queued segments survive
+    // a crash or restart. Pending items are replayed when the journal is opened. Items given up
+    // after retries (e.g. network outage) stay in the journal and are sent again one per
+    // drainInterval (sec), slower while they keep failing. Their completion (see transcript())
+    // fails when they are given up the first time, and a replayed transcript is delivered when it
+    // is done, so they don't hold back the live transcripts. After maxAttempts sends they go to
+    // the dead_letter directory of the journal. Call it before recording.
+    // directory: relative to data path. "": no journal (default)
+    void setJournal(string directory, float drainInterval = 1.0, int maxAttempts = 5);
+    // Num of items in the journal which are not done (queued, in flight or waiting to be sent again)
+    size_t getNumJournalPending();
+    
+    // Transcript cache (e.g. make_shared<ofxWhisperCache>() and setup("cache")).
+    // Audio already transcribed with the same prompt, language and model is not sent again.
+    // nullptr: no cache (default)
+    void setCache(shared_ptr<ofxWhisperCache> _cache);
+    shared_ptr<ofxWhisperCache> getCache();
+    
     // HTTP request thread
     void threadedFunction() override;
     
     // Return true if transcripts is ready
     bool hasTranscript();
     
-    // Return num of transcripts
+    // Return num of transcripts. At most maxTranscripts are kept, oldest are dropped.
     int numTranscripts();
+    static const size_t maxTranscripts = 1024;
         
     // Get oldest transcript and remove it
     string getNextTranscript();
     
     bool isRecording();
+    bool isRecording(int sourceId);
     
     float getAudioLevel();
+    float getAudioLevel(int sourceId);
     
-    // audio handling
+    // audio handling. Samples are only copied to the capture ring buffer here.
     void audioIn(ofSoundBuffer &input) override;
+    void audioIn(int sourceId, ofSoundBuffer &input);
     
     // Helper function to parse the error response and return the appropriate error code.
-    ErrorCode parseErrorResponse(const ofxHttpResponse& response);
+    static ErrorCode parseErrorResponse(const ofxHttpResponse& response);
     
     // Get the error message for a given error code.
     static string getErrorMessage(ErrorCode errorCode);
     
-    // Audio Level Changed Event
+    // Audio Level Changed Event (notified from the capture thread)
     struct AudioEventArgs {
+        int sourceId;
         float audioLevel;
+        float speechProbability;
         bool isRecording;
     };
     ofEvent<AudioEventArgs> audioEvents;
     
+    // Captured audio blocks (bufferSize frames) for meters, archives, visualizers...
+    // All subscribers get a reference to the same block of a preallocated pool. No copy per subscriber.
+    // Called from the capture thread (not the audio thread). Return quickly, and keep the
+    // reference to use the samples later. Blocks are not delivered while all blocks of the pool are held.
+    // The samples are the ones the VAD and the recording get, so the DC offset is already
+    // removed with setDcRemoval(true).
+    // sourceId: -1 for all sources. Return subscription id.
+    typedef std::function<void(const ofxWhisperAudioBlockRef &)> AudioBlockCallback;
+    int subscribeAudio(AudioBlockCallback callback, int sourceId = -1);
+    void unsubscribeAudio(int subscriptionId);
+    // Blocks per source (default:64). Call it before setupRecorder() / addDeviceSource() ...
+    void setAudioPoolSize(int numBlocks);
+    
+    // Partial transcript while streaming. Notified from the streaming thread.
+    struct PartialTranscriptEventArgs {
+        // stable text. it is never changed until the segment ends
+        string committed;
+        // latest hypothesis after committed. it may change
+        string provisional;
+        // true at the end of the segment
+        bool isFinal;
+    };
+    ofEvent<PartialTranscriptEventArgs> partialTranscriptEvents;
+    
+    // Long file progress. Notified from the upload workers.
+    struct LongFileEventArgs {
+        uint64_t id = 0;
+        string filePath;
+        int numChunks = 0;
+        int numDone = 0;
+        float progress = 0;
+        bool isFinished = false;
+        // stitched transcript when finished
+        string transcript;
+    };
+    ofEvent<LongFileEventArgs> longFileEvents;
+    
+    // Segment of a transcript (sec from the beginning of the audio)
+    struct TranscriptSegment {
+        float start = 0, end = 0;
+        string text;
+        // exp(avg_logprob) 0-1. negative if unknown
+        float confidence = -1;
+        float noSpeechProbability = -1;
+    };
+    
+    // Word timestamp (sec from the beginning of the audio)
+    struct TranscriptWord {
+        float start = 0, end = 0;
+        string word;
+    };
+    
+    // Transcript with timestamps and latency
+    struct TranscriptResult {
+        // same as the id of transcriptLongFile()
+        uint64_t id = 0;
+        // capture source. -1 for files and buffers
+        int sourceId = -1;
+        // audio file (temp wav for recorded audio). empty for in memory audio
+        string filePath;
+        
+        // recorded audio (ofGetElapsedTimeMillis). 0 if not recorded by this addon
+        uint64_t captureStartTime = 0, captureEndTime = 0;
+        
+        string text;
+        // detected language (or requested one)
+        string language;
+        // audio length (sec). negative if unknown
+        float duration = -1;
+        // mean confidence of segments 0-1. negative if unknown
+        float confidence = -1;
+        // empty if the backend does not give them
+        vector<TranscriptSegment> segments;
+        vector<TranscriptWord> words;
+        
+        // Latency (ms)
+        // added to the queue (ofGetElapsedTimeMillis)
+        uint64_t queuedTime = 0;
+        // queued -> request start (includes retry waits)
+        float queueTime = 0;
+        // request start -> response (upload + server)
+        float requestTime = 0;
+        // processing time reported by the server. negative if unknown
+        float serverTime = -1;
+        // capture end (or queued) -> delivered
+        float latency = 0;
+        
+        int attempts = 0;
+        bool fromCache = false;
+        
+        // Success, or the reason of the failure. Failed results are only given to
+        // the completion of transcript().
+        ErrorCode errorCode = Success;
+    };
+    
+    // Returned by transcript()
+    class TranscriptHandle {
+    public:
+        // same as TranscriptResult::id (see cancel())
+        uint64_t getId() const { return id; }
+        bool isValid() const { return future.valid(); }
+        std::shared_future<TranscriptResult> getFuture() const { return future; }
+        
+        // The result is set (does not block)
+        bool isReady() const {
+            return future.valid() && future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        }
+        // Wait for the result. Return false on timeout (sec, <0: no timeout)
+        bool wait(float timeout = -1) const {
+            if (!future.valid()) return false;
+            if (timeout < 0) {
+                future.wait();
+                return true;
+            }
+            return future.wait_for(std::chrono::duration<float>(timeout)) == std::future_status::ready;
+        }
+        // Wait and get the result
+        TranscriptResult get() const { return future.get(); }
+        
+    private:
+        friend class ofxWhisper;
+        uint64_t id = 0;
+        std::shared_future<TranscriptResult> future;
+    };
+    
+    // Transcript is ready. Notified in capture order from the thread which delivers it: usually
+    // an upload worker, also the capture thread or the thread calling cancel() when an earlier
+    // item is dropped or cancelled.
+    // It is also returned by getNextTranscript() / getNextResult().
+    ofEvent<TranscriptResult> transcriptEvents;
+    
+    // Get oldest transcript with timestamps and latency, and remove it
+    // (same queue as getNextTranscript())
+    TranscriptResult getNextResult();
+    
+    // Join transcripts of overlapping chunks (see transcriptLongFile()). Words repeated at the
+    // head of the next text are removed, or characters for scripts without spaces (e.g. Japanese).
+    static string stitchTranscripts(const vector<string> & texts, size_t maxOverlapWords = 20);
+    // The last character of left or the first of right is of a script written without spaces
+    // between words (e.g. Japanese). They are joined without a space.
+    static bool isUnspacedJoin(const string & left, const string & right);
+    
 private:
     ofSoundStream stream;
-    ofxSoundRecorderObject recorder;
     
-    ofEventListener recordingEndListener;
-    void recordingEndCallback(string & filePath);
-
-    // transcript history
-    vector<string> transcripts;
+    // Capture source. audioIn() (producer) -> ring -> processCapture() (consumer)
+    struct CaptureSource {
+        int id = 0;
+        string name;
+        // audioIn() writes only while configured. writers: audioIn() calls in progress,
+        // configureSource() waits for them before it reallocates the ring.
+        std::atomic<bool> configured{false};
+        std::atomic<int> writers{0};
+        int sampleRate = 48000, numChannels = 1, bufferSize = 256;
+        ofxWhisperRingBuffer<float> ring;
+        std::atomic<uint64_t> droppedSamples{0};
+        
+        // VAD and realtime recording state (capture thread)
+        float rrStartThreshold = 0, rrEndThreshold = 0;
+        uint32_t rrSilenceCoutMax = 0, rrSilenceCount = 0;
+        shared_ptr<ofxWhisperVad> vad;
+        ofMutex vadMutex;
+        float audioLevel = 0;
+        float speechProbability = 0;
+        
+        // Latest samples (interleaved) for pre-roll. preRollBlock is the copy spliced into the recording.
+        ofxWhisperHistoryBuffer<float> preRoll;
+        ofSoundBuffer preRollBlock;
+        
+        // DC offset of each channel (see setDcRemoval())
+        vector<float> dcOffsets;
+        // frames left to record after the end of speech
+        size_t postRollRemaining = 0;
+        
+        // speculative upload of the current recording (sequence of the item, recorded frames at the cut)
+        bool hasSpeculative = false;
+        uint64_t speculativeSequence = 0;
+        uint64_t speculativeFrames = 0;
+        
+        // The audio file is not valid if valid buffer count less than threshold.
+        int validBfferCount = 0;
+        
+        // Recording (wav file or memory). Started and stopped by the app and the capture threads,
+        // recordingMutex makes the transitions atomic. stopping: the recording is finishing.
+        std::atomic<bool> recording{false};
+        bool stopping = false;
+        ofMutex recordingMutex;
+        ofxSoundRecorderObject recorder;
+        ofEventListener recordingEndListener;
+        ofSoundBuffer recordingBuffer;
+        ofMutex recordingBufferMutex;
+        
+        // capture time of the current recording
+        std::atomic<uint64_t> recordingFrames{0};
+        uint64_t recordingStartTime = 0, recordingEndTime = 0;
+        
+        // blocks shared with the audio subscribers, frames read from the ring
+        ofxWhisperAudioPool audioPool;
+        uint64_t capturedFrames = 0;
+    };
+    // Sources are never removed and the vector is never reallocated (see maxSources),
+    // so the audio threads can access them without lock.
+    static const int maxSources = 64;
+    vector<unique_ptr<CaptureSource>> sources;
+    std::atomic<int> numSources{0};
+    ofMutex sourcesMutex;
+    CaptureSource * getSource(int sourceId);
+    CaptureSource & addSource(string name);
+    void configureSource(CaptureSource & source, int sampleRate, int numChannels, int bufferSize);
+    
+    // Sound device shared by sources. Channels are routed to the sources.
+    class DeviceInput : public ofBaseSoundInput {
+    public:
+        DeviceInput(ofxWhisper & owner) : owner(owner) {}
+        void audioIn(ofSoundBuffer & input) override;
+        
+        int deviceID = 0;
+        int numChannels = 0;
+        ofSoundStream stream;
+        // source id and channel (-1: all)
+        vector<pair<int, int>> routes;
+    private:
+        ofxWhisper & owner;
+        ofSoundBuffer channelBuffer;
+    };
+    vector<unique_ptr<DeviceInput>> deviceInputs;
+    
+    class CaptureWorker : public ofThread {
+    public:
+        CaptureWorker(ofxWhisper & owner) : owner(owner) {}
+        void threadedFunction() override {
+            owner.processCapture(*this);
+        }
+    private:
+        ofxWhisper & owner;
+    };
+    CaptureWorker captureWorker{*this};
+    void processCapture(ofThread & worker);
     
-    // Audio buffer que
-    vector<string> audioQue;
+    // VAD, pre-roll and recording (capture thread)
+    void processCapturedBuffer(CaptureSource & source, ofSoundBuffer &input);
     
-    ofMutex audioQueMutex, transcriptMutex;
+    // Audio subscribers (see subscribeAudio())
+    struct AudioSubscription {
+        int id;
+        int sourceId;
+        AudioBlockCallback callback;
+    };
+    // copy on write, so the callbacks are called without lock and can unsubscribe
+    shared_ptr<const vector<AudioSubscription>> audioSubscriptions;
+    ofMutex audioSubscriptionMutex;
+    int nextSubscriptionId = 1;
+    std::atomic<int> numAudioSubscriptions{0};
+    int audioPoolSize = 64;
+    void publishAudioBlock(const ofxWhisperAudioBlockRef & block);
+    
+    void recordingEndCallback(int sourceId, string & filePath);
+    
+    // In memory recording
+    bool inMemoryRecording = false;
+    
+    // True while the recorder (file or memory) is taking samples
+    bool isCapturing(CaptureSource & source);
+    
+    // Add samples to the current recording
+    void appendToRecording(CaptureSource & source, ofSoundBuffer & buffer);
+
+    // Transcripts for getNextTranscript() (workers -> app thread)
+    ofxWhisperQueue<TranscriptResult> transcripts{maxTranscripts};
+    
+    // Chunks of a long file
+    struct LongFileJob {
+        uint64_t sequence;
+        string filePath;
+        vector<string> texts;
+        int numDone = 0;
+        int numFailed = 0;
+        
+        // timestamps of chunks (sec from the beginning of chunks)
+        float duration = 0;
+        vector<float> chunkStartTimes;
+        vector<vector<TranscriptSegment>> segments;
+        vector<vector<TranscriptWord>> words;
+        string language;
+        uint64_t queuedTime = 0;
+        float requestTime = 0, serverTime = 0;
+        int attempts = 0;
+    };
+    ofMutex longFileMutex;
+    
+    // Completion of transcript() (see Executor)
+    struct Completion {
+        std::promise<TranscriptResult> promise;
+        CompletionCallback callback;
+        Executor executor = WorkerThread;
+        TranscriptResult result;
+    };
+    
+    // Audio que item. filePath or buffer (in memory) is used.
+    struct AudioQueItem {
+        string filePath;
+        ofSoundBuffer buffer;
+        uint64_t sequence = 0;
+        // recorded by this addon (wav in temp path)
+        bool recorded = false;
+        int sourceId = -1;
+        
+        // long file to be split into chunks
+        bool longFile = false;
+        float chunkTime = 60, overlapTime = 1;
+        
+        // chunk of a long file
+        shared_ptr<LongFileJob> longFileJob;
+        int chunkIndex = -1;
+        
+        // file of a batch job
+        shared_ptr<ofxWhisperBatchJob> batchJob;
+        size_t batchIndex = 0;
+        
+        // uploaded before the end of the recording (see setSpeculativeUpload())
+        bool speculative = false;
+        
+        // record in the journal (0: not journaled)
+        uint64_t journalId = 0;
+        // sent again from the journal (not counted for maxQueueSize), failed sends before
+        bool replay = false;
+        int journalAttempts = 0;
+        
+        // added by transcript()
+        shared_ptr<Completion> completion;
+        
+        // prompt when it was queued (with the context of the transcripts before it)
+        string prompt;
+        
+        // capture time of recorded audio and queued time (ms, ofGetElapsedTimeMillis)
+        uint64_t captureStartTime = 0, captureEndTime = 0;
+        uint64_t queuedTime = 0;
+        
+        // retry (ms, ofGetElapsedTimeMillis)
+        int attempts = 0;
+        uint64_t notBefore = 0;
+        uint64_t firstFailureTime = 0;
+    };
     
-    bool recording, realtimeRecording;
+    // Audio buffer que. Workers pick the first ready item, so this is not a FIFO (see findReadyItem())
+    deque<AudioQueItem> audioQue;
+    size_t maxQueueSize = 256;
+    OverflowPolicy overflowPolicy = DropOldest;
+    // num of items which are counted for maxQueueSize (audioQueMutex)
+    size_t numQueuedItems = 0;
+    // Give the item a sequence and queue it (after writing it to the journal)
+    uint64_t addToAudioQue(AudioQueItem && item);
+    // Queue an item which has a sequence, through the journal thread if it is journaled.
+    // The prompt is taken here.
+    void submitItem(AudioQueItem && item);
+    // Queue an item which has a sequence
+    void queueItem(AudioQueItem && item);
+    static bool isQueueCounted(const AudioQueItem & item);
+    // Make room for a new item (audioQueMutex must be locked).
+    // Return false if the new item is dropped or merged. Items which are not queued are moved to skipped.
+    bool handleOverflow(std::unique_lock<ofMutex> & lock, AudioQueItem & item, vector<AudioQueItem> & skipped);
+    // The calling thread is one of the upload workers (Block policy can not wait there)
+    bool isUploadWorker();
+    bool mergeWithLastItem(AudioQueItem & item);
+    
+    // Add recorded audio to audioQue if it is long enough
+    void finishRecording(CaptureSource & source, AudioQueItem && item);
+    // Drop the oldest queued recordings until the segment store fits its budget.
+    // Their files are pinned, so the store does not delete them by itself.
+    void evictQueuedSegments();
     
-    // OpenAI key
-    string apiKey;
+    ofMutex audioQueMutex, transcriptMutex;
+    std::condition_variable audioQueCondition;
+    // notified when an item is taken from audioQue (Block policy)
+    std::condition_variable audioQueSpaceCondition;
+    
+    // Upload worker pool
+    class UploadWorker : public ofThread {
+    public:
+        UploadWorker(ofxWhisper & owner) : owner(owner) {}
+        void threadedFunction() override {
+            owner.processAudioQue(*this);
+        }
+    private:
+        ofxWhisper & owner;
+    };
+    vector<unique_ptr<UploadWorker>> uploadWorkers;
+    int maxInFlight = 4;
+    int inFlight = 0;
+    void startWorkers();
+    
+    // Worker loop. Take items from audioQue until the worker is stopped.
+    void processAudioQue(ofThread & worker);
+    ofxWhisperResult processAudioQueItem(const AudioQueItem & item);
+    
+    // Retry scheduler. Return true if the item is moved back to audioQue.
+    int maxRetries = 5;
+    float retryTimeMax = 120;
+    float retryDelayBase = 1, retryDelayMax = 30;
+    std::atomic<int> numRetried{0}, numDropped{0};
+    bool scheduleRetry(AudioQueItem & item, const ofxWhisperResult & result);
+    static bool isRetryable(const ofxWhisperResult & result);
+    
+    // Pace requests by Retry-After and x-ratelimit-* headers
+    uint64_t rateLimitPausedUntil = 0;
+    void updateRateLimit(const ofxWhisperResult & result);
+    
+    // First item which is not waiting for retry (audioQueMutex must be locked)
+    deque<AudioQueItem>::iterator findReadyItem();
+    
+    // Transcripts are delivered in capture order by sequence number
+    struct FinishedItem {
+        bool success;
+        TranscriptResult result;
+    };
+    uint64_t nextSequence = 0, nextDeliverSequence = 0;
+    map<uint64_t, FinishedItem> finishedItems;
+    void deliverTranscript(uint64_t sequence, bool success, TranscriptResult && result);
+    
+    // transcriptEvents are notified in order by one thread at a time, without lock, so the
+    // listeners can call transcript() or cancel(). A listener calling back only queues.
+    deque<TranscriptResult> transcriptEventQueue;
+    bool notifyingTranscripts = false;
+    ofMutex deliverMutex;
+    void notifyTranscripts();
+    
+    // Completions by sequence. Delivered ones wait in workerCompletions (delivery order)
+    // and their futures are set by one thread at a time without lock. Callbacks go to
+    // threadCompletions (completionWorker) or mainThreadCompletions.
+    map<uint64_t, shared_ptr<Completion>> completions;
+    deque<shared_ptr<Completion>> workerCompletions, threadCompletions, mainThreadCompletions;
+    bool runningCompletions = false;
+    std::atomic<bool> hasMainThreadCompletions{false};
+    ofMutex completionMutex;
+    ofEventListener updateListener;
+    bool listeningUpdate = false;
+    TranscriptHandle addWithCompletion(AudioQueItem && item, CompletionCallback callback, Executor executor);
+    // transcriptMutex must be locked
+    void queueCompletion(uint64_t sequence, const TranscriptResult & result);
+    void runCompletions();
+    void runMainThreadCompletions();
+    
+    // WorkerThread callbacks are run on this thread, whichever thread delivered the result
+    // (upload worker, capture thread, cancel()). Started by the first one.
+    class CompletionWorker : public ofThread {
+    public:
+        CompletionWorker(ofxWhisper & owner) : owner(owner) {}
+        void threadedFunction() override {
+            owner.processThreadCompletions(*this);
+        }
+    private:
+        ofxWhisper & owner;
+    };
+    CompletionWorker completionWorker{*this};
+    std::condition_variable completionCondition;
+    void processThreadCompletions(ofThread & worker);
+    // Exceptions are logged
+    static void runCompletionCallback(Completion & completion);
+    TranscriptResult makeTranscriptResult(const AudioQueItem & item, const ofxWhisperResult & result, uint64_t requestStartTime);
+    static float getConfidence(const vector<TranscriptSegment> & segments);
+    
+    // Journal. Items given up after retries wait in journalParked (only the id, the audio is on disk).
+    // Their sequence is released, and they get a new one when they are sent again.
+    struct JournalEntry {
+        uint64_t id = 0;
+        int attempts = 0;
+    };
+    shared_ptr<ofxWhisperJournal> journal;
+    ofMutex journalMutex;
+    deque<JournalEntry> journalParked;
+    float journalDrainInterval = 1.0;
+    int journalMaxAttempts = 5;
+    // drain interval is multiplied while drained items keep failing
+    float journalBackoff = 1;
+    std::atomic<uint64_t> nextJournalDrainTime{0};
+    bool isJournaled(const AudioQueItem & item);
+    void addToJournal(AudioQueItem & item);
+    // Return true if the item is parked (its transcript is delivered when it is sent again)
+    bool finishJournalItem(const AudioQueItem & item, bool success, const ofxWhisperResult & result);
+    void drainJournal();
+    
+    // Items are written to the journal (encoding and fsync) on this thread, not on the capture
+    // thread, and queued when they are on disk. journalWrites: journalMutex
+    class JournalWorker : public ofThread {
+    public:
+        JournalWorker(ofxWhisper & owner) : owner(owner) {}
+        void threadedFunction() override {
+            owner.processJournalWrites(*this);
+        }
+    private:
+        ofxWhisper & owner;
+    };
+    JournalWorker journalWorker{*this};
+    deque<AudioQueItem> journalWrites;
+    std::condition_variable journalCondition;
+    void processJournalWrites(ofThread & worker);
+    
+    // Speculative upload. The result is held until the recording ends (confirmed)
+    // or speech starts again (discarded). The full recording is kept with a confirmed item
+    // and sent with its sequence if the speculative request failed or was cancelled.
+    bool speculativeUpload = false;
+    enum SpeculativeState {
+        SpeculativePending,
+        SpeculativeConfirmed,
+        SpeculativeDiscarded,
+    };
+    struct SpeculativeItem {
+        SpeculativeState state = SpeculativePending;
+        bool finished = false;
+        bool success = false;
+        TranscriptResult result;
+        bool hasRecording = false;
+        AudioQueItem recording;
+    };
+    map<uint64_t, SpeculativeItem> speculativeItems;
+    ofMutex speculativeMutex;
+    void startSpeculativeUpload(CaptureSource & source);
+    // recording: the full recording of a confirmed item
+    void resolveSpeculativeUpload(CaptureSource & source, bool confirmed, AudioQueItem * recording = nullptr);
+    bool isSpeculativeDiscarded(uint64_t sequence);
+    void finishSpeculativeItem(uint64_t sequence, bool success, TranscriptResult && result);
+    
+    // Batch job. Items are sent when the job has room.
+    void submitBatchItems(const shared_ptr<ofxWhisperBatchJob> & job);
+    void finishBatchItem(const AudioQueItem & item, bool success, bool cancelled, const ofxWhisperResult & result, uint64_t requestStartTime);
+    
+    // Long file
+    bool splitLongFile(const AudioQueItem & item);
+    void finishLongFileChunk(const AudioQueItem & item, bool success, const ofxWhisperResult & result, uint64_t requestStartTime);
+    static void splitAtLowEnergy(const vector<float> & pcm, int sampleRate, float chunkTime, float overlapTime, vector<pair<size_t, size_t>> & ranges);
+    
+    // Streaming
+    class StreamingWorker : public ofThread {
+    public:
+        StreamingWorker(ofxWhisper & owner) : owner(owner) {}
+        void threadedFunction() override {
+            owner.processStreaming(*this);
+        }
+    private:
+        ofxWhisper & owner;
+    };
+    StreamingWorker streamingWorker{*this};
+    bool streaming = false;
+    float streamingStepTime = 0.5, streamingWindowTime = 10.0;
+    std::atomic<bool> streamingSegmentEnded{false};
+    ofSoundBuffer streamingBuffer;
+    ofMutex streamingMutex;
+    void processStreaming(ofThread & worker);
+    
+    // Local agreement of consecutive hypotheses (streaming thread only)
+    string streamingCommitted;
+    vector<string> streamingPrevWords;
+    size_t streamingWindowCommitted = 0;
+    void updatePartialTranscript(const string & hypothesis, bool isFinal, bool windowFull);
+    
+    std::atomic<bool> realtimeRecording;
+    
+    // Transcription engine
+    shared_ptr<ofxWhisperBackend> backend;
+    
+    // Upload encoding
+    bool uploadResample = true;
+    int uploadSampleRate = 16000;
+    ofxWhisperEncoder::Format uploadFormat = ofxWhisperEncoder::Wav;
+    
+    // Transcript cache
+    shared_ptr<ofxWhisperCache> cache;
+    
+    // Instrumentation
+    ofxWhisperStats stats;
+    string statsFile;
+    float statsInterval = 10;
+    std::atomic<uint64_t> nextStatsTime{0};
+    ofMutex statsFileMutex;
+    void saveStatsFile();
     
     // prompt (send to Whidper with data)
     string prompt;
     
+    // Prompt context. contextText is the recent transcripts joined with a space. Entries are
+    // appended and removed from the head, so the string is not rebuilt for every segment.
+    bool autoContext = false;
+    int contextMaxTokens = 224;
+    struct ContextEntry {
+        size_t length;
+        float tokens;
+    };
+    deque<ContextEntry> contextEntries;
+    string contextText;
+    float contextTokens = 0;
+    ofMutex contextMutex;
+    void addToContext(string text);
+    // Drop the oldest entries to fit budget (contextMutex must be locked)
+    void trimContext(float budget);
+    float getContextBudget() const;
+    // Rough token count. ~4 ASCII chars per token, 1 token per other character (e.g. CJK)
+    static float estimateTokens(const string & text);
+    
     // language (send to Whisper with data)
     string language;
     
-    ofxHttpUtils httpUtils;
-    
-    // Realtime recording parametors
+    // Realtime recording parametors (default of sources)
     float rrStartThreshold, rrEndThreshold, rrSilenceTimeMax;
-    uint32_t rrSilenceCoutMax, rrSilenceCount = 0;
     
-    // realtime level. for audio visualizer
-    float audioLevel;
+    // VAD
+    float vadStartThreshold = 0.6, vadEndThreshold = 0.4;
     
+    // Recorded wav files. Deleted after upload.
+    ofxWhisperSegmentStore segmentStore;
     string getTempPath();
     
-    static const int audioBufferHistoryMax = 20;
-    vector<ofSoundBuffer> audioBufferHistory;
+    // Pre-roll and post-roll (ms)
+    float preRollTime = 300, postRollTime = 0;
+    void allocatePreRoll(CaptureSource & source);
     
-    // The audio file is not valid if valid buffer count less than threshold.
-    int validBfferCount;
+    std::atomic<bool> dcRemoval{false};
     const int validBfferCountThreshold = 20;
 };
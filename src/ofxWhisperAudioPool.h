@@ -0,0 +1,151 @@
+#pragma once
+#include "ofMain.h"
+#include "ofxWhisperQueue.h"
+
+class ofxWhisperAudioPool;
+
+// Captured audio block shared by the consumers (see ofxWhisper::subscribeAudio()).
+// Read only. It goes back to the pool when the last ofxWhisperAudioBlockRef is released.
+class ofxWhisperAudioBlock {
+public:
+    const ofSoundBuffer & getBuffer() const { return buffer; }
+    const float * getData() const { return buffer.getBuffer().data(); }
+    size_t getNumFrames() const { return buffer.getNumFrames(); }
+    size_t getNumChannels() const { return buffer.getNumChannels(); }
+    int getSampleRate() const { return buffer.getSampleRate(); }
+    int getSourceId() const { return sourceId; }
+    // position of the first frame in the stream of the source
+    uint64_t getFrameIndex() const { return frameIndex; }
+    // ofGetElapsedTimeMillis() when the block was taken from the capture ring
+    uint64_t getTime() const { return time; }
+
+private:
+    friend class ofxWhisperAudioPool;
+    friend class ofxWhisperAudioBlockRef;
+    friend class ofxWhisper;
+
+    struct FreeList;
+    ofxWhisperAudioBlock(const shared_ptr<FreeList> & freeList) : freeList(freeList) {}
+    void release();
+
+    ofSoundBuffer buffer;
+    int sourceId = 0;
+    uint64_t frameIndex = 0;
+    uint64_t time = 0;
+    std::atomic<int> refCount{0};
+    shared_ptr<FreeList> freeList;
+};
+
+// Counted reference to a block. Copying does not copy the samples.
+class ofxWhisperAudioBlockRef {
+public:
+    ofxWhisperAudioBlockRef() {}
+    ofxWhisperAudioBlockRef(const ofxWhisperAudioBlockRef & other) : block(other.block) {
+        if (block) block->refCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    ofxWhisperAudioBlockRef(ofxWhisperAudioBlockRef && other) : block(other.block) {
+        other.block = nullptr;
+    }
+    ~ofxWhisperAudioBlockRef() {
+        reset();
+    }
+    ofxWhisperAudioBlockRef & operator=(ofxWhisperAudioBlockRef other) {
+        std::swap(block, other.block);
+        return *this;
+    }
+
+    void reset() {
+        if (block && block->refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) block->release();
+        block = nullptr;
+    }
+
+    const ofxWhisperAudioBlock * get() const { return block; }
+    const ofxWhisperAudioBlock * operator->() const { return block; }
+    const ofxWhisperAudioBlock & operator*() const { return *block; }
+    explicit operator bool() const { return block != nullptr; }
+
+private:
+    friend class ofxWhisperAudioPool;
+    friend class ofxWhisper;
+    explicit ofxWhisperAudioBlockRef(ofxWhisperAudioBlock * block) : block(block) {}
+    // writable while the capture thread fills it (before it is published)
+    ofxWhisperAudioBlock * getMutable() const { return block; }
+
+    ofxWhisperAudioBlock * block = nullptr;
+};
+
+// Preallocated blocks of a source. acquire() and release are lock free and do not allocate.
+// Blocks still referenced when the pool is destroyed are deleted with the last reference.
+class ofxWhisperAudioPool {
+public:
+    ~ofxWhisperAudioPool();
+
+    // Not thread safe. Call it before acquire().
+    void allocate(size_t numBlocks, size_t numFrames, size_t numChannels, int sampleRate);
+
+    // Empty reference if all blocks are in use
+    ofxWhisperAudioBlockRef acquire();
+
+    size_t getNumBlocks() const;
+
+private:
+    shared_ptr<ofxWhisperAudioBlock::FreeList> freeList;
+    size_t numBlocks = 0;
+    void close();
+};
+
+struct ofxWhisperAudioBlock::FreeList {
+    ofxWhisperQueue<ofxWhisperAudioBlock *> blocks;
+    std::atomic<bool> closed{false};
+
+    void deleteAll() {
+        ofxWhisperAudioBlock * block;
+        while (blocks.tryPop(block)) delete block;
+    }
+};
+
+inline void ofxWhisperAudioBlock::release() {
+    // the block may be deleted below. keep the list alive.
+    auto list = freeList;
+    if (!list->closed && list->blocks.tryPush(this)) {
+        // the pool was closed while pushing
+        if (list->closed) list->deleteAll();
+        return;
+    }
+    delete this;
+}
+
+inline ofxWhisperAudioPool::~ofxWhisperAudioPool() {
+    close();
+}
+
+inline void ofxWhisperAudioPool::allocate(size_t _numBlocks, size_t numFrames, size_t numChannels, int sampleRate) {
+    close();
+    numBlocks = _numBlocks;
+    freeList = make_shared<ofxWhisperAudioBlock::FreeList>();
+    freeList->blocks.allocate(numBlocks);
+    for (size_t i = 0; i < numBlocks; ++i) {
+        auto block = new ofxWhisperAudioBlock(freeList);
+        block->buffer.allocate(numFrames, numChannels);
+        block->buffer.setSampleRate(sampleRate);
+        freeList->blocks.tryPush(std::move(block));
+    }
+}
+
+inline ofxWhisperAudioBlockRef ofxWhisperAudioPool::acquire() {
+    ofxWhisperAudioBlock * block;
+    if (!freeList || !freeList->blocks.tryPop(block)) return ofxWhisperAudioBlockRef();
+    block->refCount.store(1, std::memory_order_relaxed);
+    return ofxWhisperAudioBlockRef(block);
+}
+
+inline size_t ofxWhisperAudioPool::getNumBlocks() const {
+    return numBlocks;
+}
+
+inline void ofxWhisperAudioPool::close() {
+    if (!freeList) return;
+    freeList->closed = true;
+    freeList->deleteAll();
+    freeList = nullptr;
+}
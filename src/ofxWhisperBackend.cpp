@@ -0,0 +1,73 @@
+#include "ofxWhisperBackend.h"
+
+bool ofxWhisperBackend::parseVerboseJson(const string & json, Result & result) {
+    try {
+        ofJson res = ofJson::parse(json);
+        result.text = res["text"].get<string>();
+        result.language = res.value("language", "");
+        result.duration = res.value("duration", -1.f);
+        
+        result.segments.clear();
+        if (res.count("segments")) {
+            for (auto & s : res["segments"]) {
+                ofxWhisper::TranscriptSegment segment;
+                segment.start = s.value("start", 0.f);
+                segment.end = s.value("end", 0.f);
+                segment.text = ofTrim(s.value("text", ""));
+                if (s.count("avg_logprob")) {
+                    segment.confidence = exp(s["avg_logprob"].get<float>());
+                }
+                segment.noSpeechProbability = s.value("no_speech_prob", -1.f);
+                result.segments.push_back(segment);
+            }
+        }
+        
+        result.words.clear();
+        if (res.count("words")) {
+            for (auto & w : res["words"]) {
+                ofxWhisper::TranscriptWord word;
+                word.start = w.value("start", 0.f);
+                word.end = w.value("end", 0.f);
+                word.word = w.value("word", "");
+                result.words.push_back(word);
+            }
+        }
+    }
+    catch (exception & e) {
+        ofLogError("ofxWhisper") << "JOSN parse error: " << e.what();
+        return false;
+    }
+    return true;
+}
+
+string ofxWhisperBackend::toVerboseJson(const Result & result) {
+    ofJson res;
+    res["text"] = result.text;
+    if (result.language != "") res["language"] = result.language;
+    if (result.duration >= 0) res["duration"] = result.duration;
+    
+    if (!result.segments.empty()) {
+        res["segments"] = ofJson::array();
+        for (auto & segment : result.segments) {
+            ofJson s;
+            s["start"] = segment.start;
+            s["end"] = segment.end;
+            s["text"] = segment.text;
+            if (segment.confidence > 0) s["avg_logprob"] = log(segment.confidence);
+            if (segment.noSpeechProbability >= 0) s["no_speech_prob"] = segment.noSpeechProbability;
+            res["segments"].push_back(s);
+        }
+    }
+    
+    if (!result.words.empty()) {
+        res["words"] = ofJson::array();
+        for (auto & word : result.words) {
+            ofJson w;
+            w["start"] = word.start;
+            w["end"] = word.end;
+            w["word"] = word.word;
+            res["words"].push_back(w);
+        }
+    }
+    return res.dump();
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "ofxWhisper.h"
+
+// Transcription request handed to a backend
+struct ofxWhisperRequest {
+    // audio file. used when buffer is empty
+    string filePath;
+    
+    // in memory audio
+    ofSoundBuffer buffer;
+    
+    string prompt;
+    string language;
+    
+    // encoding of the buffer for upload
+    ofxWhisperEncoder::Format format = ofxWhisperEncoder::Wav;
+};
+
+// Transcription result from a backend
+struct ofxWhisperResult {
+    ofxWhisper::ErrorCode errorCode = ofxWhisper::UnknownError;
+    string text;
+    
+    // verbose result. empty (negative) if the backend does not give them
+    string language;
+    float duration = -1;
+    vector<ofxWhisper::TranscriptSegment> segments;
+    vector<ofxWhisper::TranscriptWord> words;
+    
+    // processing time on the server and response parse time (ms). negative if unknown
+    float serverTime = -1;
+    float parseTime = -1;
+    
+    // request body size
+    uint64_t bytesSent = 0;
+    
+    // set by ofxWhisper if the result is from the transcript cache
+    bool fromCache = false;
+    
+    // raw response for logging
+    string rawResponse;
+    
+    // Retry-After (sec). negative if unknown
+    float retryAfter = -1;
+    
+    // x-ratelimit-remaining-requests and x-ratelimit-reset-requests (sec). negative if unknown
+    int rateLimitRemaining = -1;
+    float rateLimitReset = -1;
+};
+
+// Transcription engine behind ofxWhisper.
+// transcribe() is called from the upload workers, possibly several at once.
+class ofxWhisperBackend {
+public:
+    typedef ofxWhisperRequest Request;
+    typedef ofxWhisperResult Result;
+    
+    virtual ~ofxWhisperBackend() {}
+    
+    // Called from ofxWhisper::setup(). Return false if the backend is not usable.
+    virtual bool setup() { return true; }
+    
+    virtual Result transcribe(const Request & request) = 0;
+    
+    virtual string getName() const = 0;
+    
+    // Model name. It is a part of the transcript cache key.
+    virtual string getModel() const { return ""; }
+    
+    // Parse OpenAI json / verbose_json response (text, language, duration, segments, words)
+    static bool parseVerboseJson(const string & json, Result & result);
+    
+    // Result to verbose_json (for the transcript cache)
+    static string toVerboseJson(const Result & result);
+};
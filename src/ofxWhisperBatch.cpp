@@ -0,0 +1,281 @@
+#include "ofxWhisperBatch.h"
+
+namespace {
+    // '*' and '?' wildcards
+    bool matchPattern(const char * pattern, const char * name) {
+        if (*pattern == '\0') return *name == '\0';
+        if (*pattern == '*') {
+            return matchPattern(pattern + 1, name) || (*name != '\0' && matchPattern(pattern, name + 1));
+        }
+        if (*name == '\0') return false;
+        return (*pattern == '?' || *pattern == *name) && matchPattern(pattern + 1, name + 1);
+    }
+
+    void findFilesInDirectory(const string & path, const vector<string> & patterns, bool recursive, vector<string> & files) {
+        ofDirectory dir(path);
+        dir.listDir();
+        for (size_t i = 0; i < dir.size(); ++i) {
+            ofFile file = dir.getFile(i);
+            if (file.isDirectory()) {
+                if (recursive) findFilesInDirectory(file.getAbsolutePath(), patterns, recursive, files);
+                continue;
+            }
+            string name = ofToLower(file.getFileName());
+            for (auto & pattern : patterns) {
+                if (matchPattern(pattern.c_str(), name.c_str())) {
+                    files.push_back(file.getAbsolutePath());
+                    break;
+                }
+            }
+        }
+    }
+
+    string toSrtTime(float sec) {
+        uint64_t ms = MAX(0, sec) * 1000 + 0.5;
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%02d:%02d:%02d,%03d", (int)(ms / 3600000), (int)(ms / 60000 % 60), (int)(ms / 1000 % 60), (int)(ms % 1000));
+        return buf;
+    }
+
+    // Length of the directory part (with the separator) which all paths have in common
+    size_t getCommonDirectoryLength(const vector<ofxWhisperBatchJob::Item> & items) {
+        if (items.empty()) return 0;
+        size_t length = items[0].filePath.size();
+        for (auto & item : items) {
+            auto & a = items[0].filePath;
+            auto & b = item.filePath;
+            size_t n = 0;
+            while (n < length && n < b.size() && a[n] == b[n]) n++;
+            length = n;
+        }
+        size_t separator = items[0].filePath.find_last_of("/\\", length == 0 ? 0 : length - 1);
+        return separator == string::npos ? 0 : separator + 1;
+    }
+
+    string toString(ofxWhisperBatchJob::State state) {
+        switch (state) {
+            case ofxWhisperBatchJob::Pending: return "pending";
+            case ofxWhisperBatchJob::Running: return "running";
+            case ofxWhisperBatchJob::Done: return "done";
+            case ofxWhisperBatchJob::Failed: return "failed";
+            case ofxWhisperBatchJob::Cancelled: return "cancelled";
+            case ofxWhisperBatchJob::Skipped: return "skipped";
+        }
+        return "";
+    }
+}
+
+ofxWhisperBatchJob::ofxWhisperBatchJob(const vector<string> & files, int _maxConcurrent, string jsonlPath, string _srtDirectory) {
+    maxConcurrent = MAX(1, _maxConcurrent);
+    items.resize(files.size());
+    promises.resize(files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        items[i].index = i;
+        // absolute, so the files done in the JSONL file are found from any working directory
+        items[i].filePath = ofFilePath::getAbsolutePath(files[i]);
+        futures.push_back(promises[i].get_future().share());
+    }
+
+    if (_srtDirectory != "") {
+        srtDirectory = ofToDataPath(_srtDirectory, true);
+        ofDirectory::createDirectory(srtDirectory, false, true);
+        srtBaseLength = getCommonDirectoryLength(items);
+    }
+
+    if (jsonlPath != "") {
+        // files done in the previous run are skipped
+        string path = ofToDataPath(jsonlPath, true);
+        set<string> doneFiles;
+        loadFinished(path, doneFiles);
+        for (auto & item : items) {
+            if (doneFiles.count(item.filePath)) finishItem(item, Skipped);
+        }
+        if (numFinished > 0) {
+            ofLogNotice("ofxWhisper") << numFinished << " files are already done in " << path;
+        }
+
+        jsonl.open(path, std::ios::app);
+        if (!jsonl) ofLogError("ofxWhisper") << "Cannot open " << path;
+    }
+}
+
+size_t ofxWhisperBatchJob::getNumItems() const {
+    return items.size();
+}
+
+size_t ofxWhisperBatchJob::getNumFinished() {
+    std::lock_guard<ofMutex> lock(mutex);
+    return numFinished;
+}
+
+size_t ofxWhisperBatchJob::getNumFailed() {
+    std::lock_guard<ofMutex> lock(mutex);
+    return numFailed;
+}
+
+float ofxWhisperBatchJob::getProgress() {
+    std::lock_guard<ofMutex> lock(mutex);
+    return items.empty() ? 1 : (float)numFinished / items.size();
+}
+
+bool ofxWhisperBatchJob::isFinished() {
+    std::lock_guard<ofMutex> lock(mutex);
+    return numFinished == items.size();
+}
+
+bool ofxWhisperBatchJob::wait(float timeout) {
+    std::unique_lock<ofMutex> lock(mutex);
+    auto finished = [this] { return numFinished == items.size(); };
+    if (timeout < 0) {
+        finishedCondition.wait(lock, finished);
+        return true;
+    }
+    return finishedCondition.wait_for(lock, std::chrono::milliseconds((int64_t)(timeout * 1000)), finished);
+}
+
+void ofxWhisperBatchJob::cancel() {
+    vector<Item> cancelledItems;
+    {
+        std::lock_guard<ofMutex> lock(mutex);
+        cancelled = true;
+        for (; nextIndex < items.size(); ++nextIndex) {
+            auto & item = items[nextIndex];
+            if (item.state != Pending) continue;
+            finishItem(item, Cancelled);
+            cancelledItems.push_back(item);
+        }
+    }
+    finishedCondition.notify_all();
+    for (auto & item : cancelledItems) {
+        ofNotifyEvent(itemEvents, item);
+    }
+}
+
+bool ofxWhisperBatchJob::isCancelled() const {
+    return cancelled;
+}
+
+ofxWhisperBatchJob::Item ofxWhisperBatchJob::getItem(size_t index) {
+    std::lock_guard<ofMutex> lock(mutex);
+    return index < items.size() ? items[index] : Item();
+}
+
+std::shared_future<ofxWhisperBatchJob::Item> ofxWhisperBatchJob::getFuture(size_t index) {
+    return index < futures.size() ? futures[index] : std::shared_future<Item>();
+}
+
+vector<string> ofxWhisperBatchJob::findFiles(string directory, string pattern, bool recursive) {
+    vector<string> patterns;
+    for (auto & p : ofSplitString(ofToLower(pattern), ";", true, true)) {
+        patterns.push_back(p);
+    }
+    vector<string> files;
+    findFilesInDirectory(ofToDataPath(directory, true), patterns, recursive, files);
+    sort(files.begin(), files.end());
+    return files;
+}
+
+bool ofxWhisperBatchJob::takeNext(size_t & index, string & filePath) {
+    std::lock_guard<ofMutex> lock(mutex);
+    if (cancelled || numRunning >= maxConcurrent) return false;
+    while (nextIndex < items.size() && items[nextIndex].state != Pending) {
+        nextIndex++;
+    }
+    if (nextIndex >= items.size()) return false;
+
+    auto & item = items[nextIndex++];
+    item.state = Running;
+    numRunning++;
+    index = item.index;
+    filePath = item.filePath;
+    return true;
+}
+
+void ofxWhisperBatchJob::finish(size_t index, State state, ofxWhisper::TranscriptResult && result) {
+    Item item;
+    {
+        std::lock_guard<ofMutex> lock(mutex);
+        auto & target = items[index];
+        target.result = std::move(result);
+        numRunning--;
+        finishItem(target, state);
+        item = target;
+
+        // written before the next item, so the file has every finished item
+        if (jsonl.is_open()) writeJsonl(item);
+        if (srtDirectory != "" && state == Done) writeSrt(item);
+    }
+    finishedCondition.notify_all();
+    ofNotifyEvent(itemEvents, item);
+}
+
+void ofxWhisperBatchJob::finishItem(Item & item, State state) {
+    item.state = state;
+    numFinished++;
+    if (state == Failed) numFailed++;
+    promises[item.index].set_value(item);
+}
+
+void ofxWhisperBatchJob::loadFinished(const string & path, set<string> & files) {
+    std::ifstream file(path);
+    string line;
+    while (std::getline(file, line)) {
+        // the last line may be cut by a crash
+        try {
+            auto json = ofJson::parse(line);
+            if (json.value("state", "") == "done") files.insert(ofFilePath::getAbsolutePath(json.value("file", "")));
+        } catch (std::exception &) {
+            ofLogWarning("ofxWhisper") << "Skip broken line in " << path;
+        }
+    }
+}
+
+void ofxWhisperBatchJob::writeJsonl(const Item & item) {
+    auto & r = item.result;
+    ofJson json;
+    json["file"] = item.filePath;
+    json["state"] = toString(item.state);
+    if (item.state == Done) {
+        json["text"] = r.text;
+        json["language"] = r.language;
+        json["duration"] = r.duration;
+        json["confidence"] = r.confidence;
+        json["segments"] = ofJson::array();
+        for (auto & segment : r.segments) {
+            json["segments"].push_back({{"start", segment.start}, {"end", segment.end}, {"text", segment.text}});
+        }
+    }
+    json["attempts"] = r.attempts;
+    json["latency_ms"] = r.latency;
+    jsonl << json.dump() << std::endl;
+}
+
+void ofxWhisperBatchJob::writeSrt(const Item & item) {
+    auto & r = item.result;
+    stringstream ss;
+    if (r.segments.empty()) {
+        ss << "1\n" << toSrtTime(0) << " --> " << toSrtTime(r.duration) << "\n" << ofTrim(r.text) << "\n\n";
+    }
+    for (size_t i = 0; i < r.segments.size(); ++i) {
+        auto & segment = r.segments[i];
+        ss << i + 1 << "\n" << toSrtTime(segment.start) << " --> " << toSrtTime(segment.end) << "\n" << ofTrim(segment.text) << "\n\n";
+    }
+
+    // directories under the common one are mirrored, so files of the same name don't collide
+    string relativeDirectory = ofFilePath::getEnclosingDirectory(item.filePath.substr(srtBaseLength), false);
+    string directory = ofFilePath::join(srtDirectory, relativeDirectory);
+    if (relativeDirectory != "") ofDirectory::createDirectory(directory, false, true);
+    
+    // replaced atomically, so a crash does not leave a half written file
+    string path = ofFilePath::join(directory, ofFilePath::getBaseName(item.filePath) + ".srt");
+    string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::trunc);
+        file << ss.str();
+        if (!file) {
+            ofLogError("ofxWhisper") << "Cannot write " << tmpPath;
+            return;
+        }
+    }
+    ofFile::moveFromTo(tmpPath, path, false, true);
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "ofMain.h"
+#include "ofxWhisper.h"
+
+// Batch transcription job (see ofxWhisper::transcriptBatch()).
+// Files are fed to the upload workers up to maxConcurrent at a time, so a long list
+// does not fill the upload queue. Results are appended to a JSONL file and/or written as
+// SRT files as soon as each file is done. SRT files are written in the same directory tree as the
+// audio files (under their common directory). Files already done in the JSONL file are skipped,
+// so a job can be started again after a crash.
+class ofxWhisperBatchJob {
+public:
+    enum State {
+        Pending,
+        Running,
+        Done,
+        Failed,
+        Cancelled,
+        // already done in the JSONL file
+        Skipped,
+    };
+
+    struct Item {
+        size_t index = 0;
+        // absolute path
+        string filePath;
+        State state = Pending;
+        ofxWhisper::TranscriptResult result;
+    };
+
+    // jsonlPath, srtDirectory: "" for no output (relative to data path)
+    ofxWhisperBatchJob(const vector<string> & files, int maxConcurrent = 8, string jsonlPath = "", string srtDirectory = "");
+
+    size_t getNumItems() const;
+    // Done, failed, cancelled or skipped
+    size_t getNumFinished();
+    size_t getNumFailed();
+    // 0 - 1
+    float getProgress();
+    bool isFinished();
+
+    // Wait until all items are finished. Return false on timeout (sec, <0: no timeout)
+    bool wait(float timeout = -1);
+
+    // Items not sent yet are cancelled. Requests in flight are finished.
+    void cancel();
+    bool isCancelled() const;
+
+    Item getItem(size_t index);
+    // Set when the item is finished
+    std::shared_future<Item> getFuture(size_t index);
+
+    // Notified from the upload workers when an item is finished
+    ofEvent<Item> itemEvents;
+
+    // Files in directory matching pattern (e.g. "*.wav;*.mp3", case insensitive), sorted
+    static vector<string> findFiles(string directory, string pattern = "*", bool recursive = true);
+
+private:
+    friend class ofxWhisper;
+
+    // Next item to send if the job has room (called by ofxWhisper)
+    bool takeNext(size_t & index, string & filePath);
+    void finish(size_t index, State state, ofxWhisper::TranscriptResult && result);
+
+    ofMutex mutex;
+    std::condition_variable finishedCondition;
+    vector<Item> items;
+    vector<std::promise<Item>> promises;
+    vector<std::shared_future<Item>> futures;
+    size_t nextIndex = 0;
+    int maxConcurrent = 8, numRunning = 0;
+    size_t numFinished = 0, numFailed = 0;
+    std::atomic<bool> cancelled{false};
+
+    // Output
+    std::ofstream jsonl;
+    string srtDirectory;
+    // SRT files are written in the relative directory of the audio under this length of the paths
+    size_t srtBaseLength = 0;
+    void loadFinished(const string & path, set<string> & files);
+    void writeJsonl(const Item & item);
+    void writeSrt(const Item & item);
+    void finishItem(Item & item, State state);
+};
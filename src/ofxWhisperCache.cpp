@@ -0,0 +1,389 @@
+#include "ofxWhisperCache.h"
+#include "Poco/SharedMemory.h"
+#include "Poco/File.h"
+#include "Poco/Exception.h"
+
+namespace {
+    const char indexMagic[4] = {'O', 'F', 'W', 'C'};
+    const uint32_t indexVersion = 1;
+    const uint32_t indexCapacityMin = 1 << 14;
+
+    // approximate memory of an LRU entry except the text
+    const size_t entryOverhead = 64;
+
+    inline uint64_t rotl(uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    inline uint64_t fmix(uint64_t k) {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdULL;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ULL;
+        k ^= k >> 33;
+        return k;
+    }
+
+    // 128bit hash with two independent lanes (not cryptographic)
+    struct Hasher {
+        uint64_t h1 = 0x9e3779b97f4a7c15ULL, h2 = 0x6a09e667f3bcc909ULL;
+        uint64_t length = 0;
+
+        void add(const void * data, size_t size) {
+            const uint8_t * p = (const uint8_t *)data;
+            size_t n = size / 8;
+            for (size_t i = 0; i < n; ++i) {
+                uint64_t w;
+                memcpy(&w, p + i * 8, 8);
+                h1 = rotl(h1 ^ (w * 0x87c37b91114253d5ULL), 31) * 0x4cf5ad432745937fULL;
+                h2 = rotl(h2 + w, 27) * 0x52dce729ULL + 0x38495ab5ULL;
+            }
+            uint64_t tail = 0;
+            if (size > n * 8) memcpy(&tail, p + n * 8, size - n * 8);
+            h1 ^= fmix(tail + size);
+            h2 += fmix(tail ^ (size << 32));
+            length += size;
+        }
+
+        void add(const string & text) {
+            uint64_t size = text.size();
+            add(&size, sizeof(size));
+            add(text.data(), text.size());
+        }
+
+        ofxWhisperCache::Key finish() {
+            ofxWhisperCache::Key key;
+            key.hi = fmix(h1 ^ length) + h2;
+            key.lo = fmix(h2 ^ length) + key.hi;
+            // 0 is empty slot
+            if (!key.isValid()) key.lo = 1;
+            return key;
+        }
+    };
+}
+
+ofxWhisperCache::ofxWhisperCache() {
+}
+
+ofxWhisperCache::~ofxWhisperCache() {
+    closeDisk();
+}
+
+bool ofxWhisperCache::setup(string _directory, size_t _maxMemoryBytes, size_t _maxDiskBytes) {
+    std::lock_guard<ofMutex> lock(mutex);
+    maxMemoryBytes = _maxMemoryBytes;
+    maxDiskBytes = _maxDiskBytes;
+
+    closeDisk();
+    directory = _directory == "" ? "" : ofToDataPath(_directory, true);
+    if (directory == "") return true;
+    return openDisk();
+}
+
+ofxWhisperCache::Key ofxWhisperCache::makeKey(const ofSoundBuffer & pcm, const string & prompt, const string & language, const string & model) {
+    Hasher hasher;
+    uint32_t format[2] = {(uint32_t)pcm.getSampleRate(), (uint32_t)pcm.getNumChannels()};
+    hasher.add(format, sizeof(format));
+    hasher.add(pcm.getBuffer().data(), pcm.getBuffer().size() * sizeof(float));
+    hasher.add(prompt);
+    hasher.add(language);
+    hasher.add(model);
+    return hasher.finish();
+}
+
+bool ofxWhisperCache::get(const Key & key, string & text) {
+    std::lock_guard<ofMutex> lock(mutex);
+
+    auto it = lruMap.find(key);
+    if (it != lruMap.end()) {
+        lru.splice(lru.begin(), lru, it->second);
+        text = it->second->second;
+        numHits++;
+        return true;
+    }
+
+    if (index && getDisk(key, text)) {
+        putMemory(key, text);
+        numHits++;
+        return true;
+    }
+
+    numMisses++;
+    return false;
+}
+
+void ofxWhisperCache::put(const Key & key, const string & text) {
+    if (!key.isValid()) return;
+    std::lock_guard<ofMutex> lock(mutex);
+    putMemory(key, text);
+    if (index) putDisk(key, text);
+}
+
+void ofxWhisperCache::clear() {
+    std::lock_guard<ofMutex> lock(mutex);
+    lru.clear();
+    lruMap.clear();
+    memoryBytes = 0;
+
+    if (index) {
+        closeDisk();
+        ofFile::removeFile(getIndexPath(), false);
+        ofFile::removeFile(getDataPath(), false);
+        openDisk();
+    }
+}
+
+int ofxWhisperCache::getNumHits() const {
+    return numHits;
+}
+
+int ofxWhisperCache::getNumMisses() const {
+    return numMisses;
+}
+
+size_t ofxWhisperCache::getNumMemoryEntries() {
+    std::lock_guard<ofMutex> lock(mutex);
+    return lru.size();
+}
+
+size_t ofxWhisperCache::getNumDiskEntries() {
+    std::lock_guard<ofMutex> lock(mutex);
+    return index ? header()->count : 0;
+}
+
+void ofxWhisperCache::putMemory(const Key & key, const string & text) {
+    auto it = lruMap.find(key);
+    if (it != lruMap.end()) {
+        memoryBytes -= it->second->second.size() + entryOverhead;
+        lru.erase(it->second);
+        lruMap.erase(it);
+    }
+
+    size_t size = text.size() + entryOverhead;
+    if (size > maxMemoryBytes) return;
+
+    lru.emplace_front(key, text);
+    lruMap[key] = lru.begin();
+    memoryBytes += size;
+
+    // evict the least recently used
+    while (memoryBytes > maxMemoryBytes && !lru.empty()) {
+        memoryBytes -= lru.back().second.size() + entryOverhead;
+        lruMap.erase(lru.back().first);
+        lru.pop_back();
+    }
+}
+
+bool ofxWhisperCache::openDisk() {
+    ofDirectory::createDirectory(directory, false, true);
+
+    // data file is kept open for append and random read
+    if (!ofFile::doesFileExist(getDataPath(), false)) {
+        std::ofstream(getDataPath(), std::ios::binary);
+    }
+    data.open(getDataPath(), std::ios::in | std::ios::out | std::ios::binary);
+    if (!data.is_open()) {
+        ofLogError("ofxWhisper") << "Cannot open cache " << getDataPath();
+        return false;
+    }
+    data.seekg(0, std::ios::end);
+    dataSize = data.tellg();
+
+    // broken or old index. start with an empty cache.
+    if (!mapIndex(0, false)) {
+        data.close();
+        data.open(getDataPath(), std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+        dataSize = 0;
+        if (!mapIndex(indexCapacityMin, true)) {
+            ofLogError("ofxWhisper") << "Cannot create cache index " << getIndexPath();
+            data.close();
+            return false;
+        }
+    }
+
+    ofLogVerbose("ofxWhisper") << "Cache " << directory << ": " << header()->count << " entries";
+    return true;
+}
+
+void ofxWhisperCache::closeDisk() {
+    index.reset();
+    if (data.is_open()) data.close();
+    dataSize = 0;
+}
+
+bool ofxWhisperCache::mapIndex(uint32_t capacity, bool create) {
+    index.reset();
+    string path = getIndexPath();
+    size_t headerSize = sizeof(IndexHeader);
+
+    try {
+        if (create) {
+            // the file is allocated with zeros (empty slots) before mapping
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            file.seekp(headerSize + (size_t)capacity * sizeof(Slot) - 1);
+            file.put(0);
+            file.close();
+            if (!file) return false;
+        } else {
+            Poco::File file(path);
+            if (!file.exists() || file.getSize() < headerSize) return false;
+        }
+
+        index.reset(new Poco::SharedMemory(Poco::File(path), Poco::SharedMemory::AM_WRITE));
+    }
+    catch (Poco::Exception & e) {
+        ofLogError("ofxWhisper") << "Cache index: " << e.displayText();
+        index.reset();
+        return false;
+    }
+
+    size_t mappedSize = index->end() - index->begin();
+    IndexHeader * h = header();
+    if (create) {
+        memcpy(h->magic, indexMagic, 4);
+        h->version = indexVersion;
+        h->capacity = capacity;
+        h->count = 0;
+        h->clock = 0;
+    } else if (memcmp(h->magic, indexMagic, 4) != 0 || h->version != indexVersion
+               || h->capacity == 0 || mappedSize < headerSize + (size_t)h->capacity * sizeof(Slot)) {
+        index.reset();
+        return false;
+    }
+    return true;
+}
+
+ofxWhisperCache::IndexHeader * ofxWhisperCache::header() {
+    return (IndexHeader *)index->begin();
+}
+
+ofxWhisperCache::Slot * ofxWhisperCache::findSlot(const Key & key) {
+    IndexHeader * h = header();
+    Slot * slots = (Slot *)(index->begin() + sizeof(IndexHeader));
+
+    // linear probing. the table is never full (see putDisk)
+    for (uint32_t i = 0, n = h->capacity; i < n; ++i) {
+        Slot & slot = slots[(key.lo + i) % n];
+        if (slot.keyHi == 0 && slot.keyLo == 0) return &slot;
+        if (slot.keyHi == key.hi && slot.keyLo == key.lo) return &slot;
+    }
+    return nullptr;
+}
+
+bool ofxWhisperCache::getDisk(const Key & key, string & text) {
+    Slot * slot = findSlot(key);
+    if (!slot || slot->keyHi != key.hi || slot->keyLo != key.lo) return false;
+    if (slot->offset + slot->length > dataSize) return false;
+
+    text.resize(slot->length);
+    data.clear();
+    data.seekg(slot->offset);
+    data.read(&text[0], slot->length);
+    if (!data) {
+        data.clear();
+        return false;
+    }
+
+    slot->lastUsed = ++header()->clock;
+    return true;
+}
+
+void ofxWhisperCache::putDisk(const Key & key, const string & text) {
+    if (text.size() > maxDiskBytes / 2) return;
+
+    IndexHeader * h = header();
+    if (dataSize + text.size() > maxDiskBytes) {
+        rebuildDisk(h->capacity, true);
+    } else if ((h->count + 1) * 10 > h->capacity * 7) {
+        rebuildDisk(h->capacity * 2, false);
+    }
+    if (!index) return;
+
+    // data first, then the slot points to it
+    data.clear();
+    data.seekp(dataSize);
+    data.write(text.data(), text.size());
+    data.flush();
+    if (!data) {
+        ofLogError("ofxWhisper") << "Cannot write cache " << getDataPath();
+        data.clear();
+        return;
+    }
+
+    h = header();
+    Slot * slot = findSlot(key);
+    if (!slot) return;
+    if (slot->keyHi == 0 && slot->keyLo == 0) h->count++;
+    slot->keyHi = key.hi;
+    slot->keyLo = key.lo;
+    slot->offset = dataSize;
+    slot->length = text.size();
+    slot->lastUsed = ++h->clock;
+    dataSize += text.size();
+}
+
+void ofxWhisperCache::rebuildDisk(uint32_t capacity, bool compact) {
+    IndexHeader * h = header();
+    Slot * slots = (Slot *)(index->begin() + sizeof(IndexHeader));
+    uint32_t clock = h->clock;
+
+    vector<Slot> live;
+    live.reserve(h->count);
+    for (uint32_t i = 0; i < h->capacity; ++i) {
+        if (slots[i].keyHi != 0 || slots[i].keyLo != 0) live.push_back(slots[i]);
+    }
+
+    if (compact) {
+        // keep the recently used half of the budget
+        std::sort(live.begin(), live.end(), [](const Slot & a, const Slot & b) {
+            return a.lastUsed > b.lastUsed;
+        });
+
+        string tmpPath = getDataPath() + ".tmp";
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        vector<char> text;
+        uint64_t size = 0;
+        size_t numKept = 0;
+        for (auto & slot : live) {
+            if (size + slot.length > maxDiskBytes / 2) break;
+            if (slot.offset + slot.length > dataSize) continue;
+            text.resize(slot.length);
+            data.clear();
+            data.seekg(slot.offset);
+            data.read(text.data(), slot.length);
+            out.write(text.data(), slot.length);
+            slot.offset = size;
+            size += slot.length;
+            live[numKept++] = slot;
+        }
+        live.resize(numKept);
+        out.close();
+
+        data.close();
+        ofFile::moveFromTo(tmpPath, getDataPath(), false, true);
+        data.open(getDataPath(), std::ios::in | std::ios::out | std::ios::binary);
+        dataSize = size;
+        ofLogVerbose("ofxWhisper") << "Cache compacted: " << live.size() << " entries";
+    }
+
+    if (!mapIndex(MAX(capacity, indexCapacityMin), true)) {
+        ofLogError("ofxWhisper") << "Cannot rebuild cache index " << getIndexPath();
+        return;
+    }
+    h = header();
+    h->clock = clock;
+    for (auto & slot : live) {
+        Slot * dst = findSlot({slot.keyHi, slot.keyLo});
+        if (!dst) break;
+        *dst = slot;
+        h->count++;
+    }
+}
+
+string ofxWhisperCache::getIndexPath() const {
+    return ofFilePath::join(directory, "index.bin");
+}
+
+string ofxWhisperCache::getDataPath() const {
+    return ofFilePath::join(directory, "data.bin");
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include "ofMain.h"
+
+namespace Poco { class SharedMemory; }
+
+// Content addressed transcript cache.
+// The key is a hash of the decoded PCM + prompt + language + model, so the same clip is
+// transcribed only once even if it is loaded from a different file.
+// Recent entries are kept in memory (LRU). If a directory is given, entries are also stored
+// on disk and the hash index is memory mapped, so lookups stay cheap with many entries.
+// Thread safe. get() and put() are called from the upload workers.
+class ofxWhisperCache {
+public:
+    struct Key {
+        uint64_t hi = 0, lo = 0;
+        bool isValid() const { return hi != 0 || lo != 0; }
+        bool operator==(const Key & other) const { return hi == other.hi && lo == other.lo; }
+    };
+
+    ofxWhisperCache();
+    ~ofxWhisperCache();
+
+    // directory: on disk cache (relative to data path). "" is in memory only.
+    bool setup(string directory = "", size_t maxMemoryBytes = 4 << 20, size_t maxDiskBytes = 256 << 20);
+
+    static Key makeKey(const ofSoundBuffer & pcm, const string & prompt, const string & language, const string & model);
+
+    // Return true and the transcript if the key is cached
+    bool get(const Key & key, string & text);
+    void put(const Key & key, const string & text);
+
+    // Remove all entries (memory and disk)
+    void clear();
+
+    int getNumHits() const;
+    int getNumMisses() const;
+
+    // Num of entries in memory / on disk
+    size_t getNumMemoryEntries();
+    size_t getNumDiskEntries();
+
+private:
+    struct KeyHash {
+        size_t operator()(const Key & key) const { return key.lo; }
+    };
+
+    ofMutex mutex;
+    std::atomic<int> numHits{0}, numMisses{0};
+
+    // Memory (LRU, front is the newest)
+    size_t maxMemoryBytes = 4 << 20, memoryBytes = 0;
+    list<pair<Key, string>> lru;
+    unordered_map<Key, list<pair<Key, string>>::iterator, KeyHash> lruMap;
+    void putMemory(const Key & key, const string & text);
+
+    // Disk. index.bin is an open addressing hash table of Slot (memory mapped).
+    // data.bin is the transcripts appended one after another.
+    struct IndexHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t capacity;
+        uint32_t count;
+        // incremented for every access. used as the last used time of slots.
+        uint32_t clock;
+        uint32_t reserved[3];
+    };
+    struct Slot {
+        uint64_t keyHi, keyLo;
+        uint64_t offset;
+        uint32_t length;
+        uint32_t lastUsed;
+    };
+    string directory;
+    size_t maxDiskBytes = 256 << 20;
+    unique_ptr<Poco::SharedMemory> index;
+    std::fstream data;
+    uint64_t dataSize = 0;
+
+    bool openDisk();
+    void closeDisk();
+    bool mapIndex(uint32_t capacity, bool create);
+    IndexHeader * header();
+    Slot * findSlot(const Key & key);
+    bool getDisk(const Key & key, string & text);
+    void putDisk(const Key & key, const string & text);
+
+    // Rewrite index (and data if compact) with the live entries. Oldest entries are dropped to fit.
+    void rebuildDisk(uint32_t capacity, bool compact);
+
+    string getIndexPath() const;
+    string getDataPath() const;
+};
@@ -0,0 +1,392 @@
+#include "ofxWhisperDsp.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define OFXWHISPER_DSP_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OFXWHISPER_DSP_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define OFXWHISPER_DSP_NEON
+#endif
+#if defined(OFXWHISPER_DSP_AVX2) || defined(OFXWHISPER_DSP_SSE2) || defined(OFXWHISPER_DSP_NEON)
+#define OFXWHISPER_DSP_SIMD
+#endif
+
+namespace {
+    std::atomic<bool> simdEnabled{true};
+
+    // Scalar versions. Also used for the tails of the vectorized ones.
+
+    float peakScalar(const float * data, size_t numSamples) {
+        float peak = 0;
+        for (size_t i = 0; i < numSamples; ++i) {
+            peak = MAX(peak, fabsf(data[i]));
+        }
+        return peak;
+    }
+
+    float sumOfSquaresScalar(const float * data, size_t numSamples) {
+        float sum = 0;
+        for (size_t i = 0; i < numSamples; ++i) {
+            sum += data[i] * data[i];
+        }
+        return sum;
+    }
+
+    void downmixScalar(const float * data, size_t numFrames, size_t numChannels, float * out) {
+        float gain = 1.0 / numChannels;
+        for (size_t i = 0; i < numFrames; ++i) {
+            float sum = 0;
+            for (size_t c = 0; c < numChannels; ++c) {
+                sum += data[i * numChannels + c];
+            }
+            out[i] = sum * gain;
+        }
+    }
+
+    inline int16_t toInt16Scalar(float s) {
+        // round to nearest even like the vector conversions
+        return (int16_t)lrintf(ofClamp(s, -1, 1) * 32767);
+    }
+
+    void toInt16Scalar(const float * data, size_t numSamples, int16_t * out) {
+        for (size_t i = 0; i < numSamples; ++i) {
+            out[i] = toInt16Scalar(data[i]);
+        }
+    }
+
+    void updateDc(const float * sums, size_t numFrames, size_t numChannels, float * dc, float k) {
+        for (size_t c = 0; c < numChannels; ++c) {
+            dc[c] += (sums[c] / numFrames - dc[c]) * k;
+        }
+    }
+
+    void removeDcScalar(float * data, size_t numFrames, size_t numChannels, float * dc, float k) {
+        for (size_t c = 0; c < numChannels; ++c) {
+            float sum = 0;
+            for (size_t i = 0; i < numFrames; ++i) {
+                sum += data[i * numChannels + c];
+            }
+            updateDc(&sum, numFrames, 1, dc + c, k);
+            for (size_t i = 0; i < numFrames; ++i) {
+                data[i * numChannels + c] -= dc[c];
+            }
+        }
+    }
+
+    // Vector operations of the target. The kernels below are written once with them.
+#if defined(OFXWHISPER_DSP_AVX2)
+    struct Simd {
+        typedef __m256 Vec;
+        static const size_t width = 8;
+        static const char * name() { return "avx2"; }
+        static Vec load(const float * p) { return _mm256_loadu_ps(p); }
+        static void store(float * p, Vec v) { _mm256_storeu_ps(p, v); }
+        static Vec set(float s) { return _mm256_set1_ps(s); }
+        static Vec add(Vec a, Vec b) { return _mm256_add_ps(a, b); }
+        static Vec sub(Vec a, Vec b) { return _mm256_sub_ps(a, b); }
+        static Vec mul(Vec a, Vec b) { return _mm256_mul_ps(a, b); }
+        static Vec min(Vec a, Vec b) { return _mm256_min_ps(a, b); }
+        static Vec max(Vec a, Vec b) { return _mm256_max_ps(a, b); }
+        static Vec abs(Vec v) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), v); }
+        static __m128 half(Vec v) { return _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)); }
+        static float sum(Vec v) {
+            __m128 s = half(v);
+            s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+            s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+            return _mm_cvtss_f32(s);
+        }
+        static float max(Vec v) {
+            __m128 m = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+            m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+            m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+            return _mm_cvtss_f32(m);
+        }
+        // sum of the 2 channels of width frames
+        static Vec pairSum(const float * p) {
+            Vec a = load(p), b = load(p + width);
+            // even / odd samples in 128 bit lanes: a0 a2 b0 b2 a4 a6 b4 b6
+            Vec even = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+            Vec odd = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+            return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_add_ps(even, odd)), _MM_SHUFFLE(3, 1, 2, 0)));
+        }
+        // 2 * width samples (already scaled)
+        static void storeInt16(int16_t * p, Vec a, Vec b) {
+            __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+            _mm256_storeu_si256((__m256i *)p, _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+        }
+    };
+#elif defined(OFXWHISPER_DSP_SSE2)
+    struct Simd {
+        typedef __m128 Vec;
+        static const size_t width = 4;
+        static const char * name() { return "sse2"; }
+        static Vec load(const float * p) { return _mm_loadu_ps(p); }
+        static void store(float * p, Vec v) { _mm_storeu_ps(p, v); }
+        static Vec set(float s) { return _mm_set1_ps(s); }
+        static Vec add(Vec a, Vec b) { return _mm_add_ps(a, b); }
+        static Vec sub(Vec a, Vec b) { return _mm_sub_ps(a, b); }
+        static Vec mul(Vec a, Vec b) { return _mm_mul_ps(a, b); }
+        static Vec min(Vec a, Vec b) { return _mm_min_ps(a, b); }
+        static Vec max(Vec a, Vec b) { return _mm_max_ps(a, b); }
+        static Vec abs(Vec v) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), v); }
+        static float sum(Vec v) {
+            v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+            v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+            return _mm_cvtss_f32(v);
+        }
+        static float max(Vec v) {
+            v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+            v = _mm_max_ss(v, _mm_shuffle_ps(v, v, 1));
+            return _mm_cvtss_f32(v);
+        }
+        static Vec pairSum(const float * p) {
+            Vec a = load(p), b = load(p + width);
+            return _mm_add_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+        static void storeInt16(int16_t * p, Vec a, Vec b) {
+            _mm_storeu_si128((__m128i *)p, _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+        }
+    };
+#elif defined(OFXWHISPER_DSP_NEON)
+    struct Simd {
+        typedef float32x4_t Vec;
+        static const size_t width = 4;
+        static const char * name() { return "neon"; }
+        static Vec load(const float * p) { return vld1q_f32(p); }
+        static void store(float * p, Vec v) { vst1q_f32(p, v); }
+        static Vec set(float s) { return vdupq_n_f32(s); }
+        static Vec add(Vec a, Vec b) { return vaddq_f32(a, b); }
+        static Vec sub(Vec a, Vec b) { return vsubq_f32(a, b); }
+        static Vec mul(Vec a, Vec b) { return vmulq_f32(a, b); }
+        static Vec min(Vec a, Vec b) { return vminq_f32(a, b); }
+        static Vec max(Vec a, Vec b) { return vmaxq_f32(a, b); }
+        static Vec abs(Vec v) { return vabsq_f32(v); }
+        static float sum(Vec v) {
+#if defined(__aarch64__)
+            return vaddvq_f32(v);
+#else
+            float32x2_t s = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+            return vget_lane_f32(vpadd_f32(s, s), 0);
+#endif
+        }
+        static float max(Vec v) {
+#if defined(__aarch64__)
+            return vmaxvq_f32(v);
+#else
+            float32x2_t m = vmax_f32(vget_low_f32(v), vget_high_f32(v));
+            return vget_lane_f32(vpmax_f32(m, m), 0);
+#endif
+        }
+        static Vec pairSum(const float * p) {
+            float32x4x2_t v = vld2q_f32(p);
+            return vaddq_f32(v.val[0], v.val[1]);
+        }
+        static int32x4_t round(Vec v) {
+#if defined(__aarch64__)
+            return vcvtnq_s32_f32(v);
+#else
+            // armv7 converts toward zero. add +-0.5 (ties away from zero)
+            uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(v), vdupq_n_u32(0x80000000));
+            Vec offset = vreinterpretq_f32_u32(vorrq_u32(sign, vreinterpretq_u32_f32(vdupq_n_f32(0.5f))));
+            return vcvtq_s32_f32(vaddq_f32(v, offset));
+#endif
+        }
+        static void storeInt16(int16_t * p, Vec a, Vec b) {
+            vst1q_s16(p, vcombine_s16(vqmovn_s32(round(a)), vqmovn_s32(round(b))));
+        }
+    };
+#endif
+
+#ifdef OFXWHISPER_DSP_SIMD
+    typedef Simd::Vec Vec;
+    const size_t W = Simd::width;
+
+    float peakSimd(const float * data, size_t numSamples) {
+        // 2 accumulators to hide the latency
+        Vec m0 = Simd::set(0), m1 = Simd::set(0);
+        size_t i = 0;
+        for (; i + 2 * W <= numSamples; i += 2 * W) {
+            m0 = Simd::max(m0, Simd::abs(Simd::load(data + i)));
+            m1 = Simd::max(m1, Simd::abs(Simd::load(data + i + W)));
+        }
+        float peak = Simd::max(Simd::max(m0, m1));
+        return MAX(peak, peakScalar(data + i, numSamples - i));
+    }
+
+    float sumOfSquaresSimd(const float * data, size_t numSamples) {
+        Vec s0 = Simd::set(0), s1 = Simd::set(0);
+        size_t i = 0;
+        for (; i + 2 * W <= numSamples; i += 2 * W) {
+            Vec a = Simd::load(data + i), b = Simd::load(data + i + W);
+            s0 = Simd::add(s0, Simd::mul(a, a));
+            s1 = Simd::add(s1, Simd::mul(b, b));
+        }
+        return Simd::sum(Simd::add(s0, s1)) + sumOfSquaresScalar(data + i, numSamples - i);
+    }
+
+    void downmixSimd(const float * data, size_t numFrames, size_t numChannels, float * out) {
+        if (numChannels == 1) {
+            memcpy(out, data, numFrames * sizeof(float));
+        } else if (numChannels == 2) {
+            Vec gain = Simd::set(0.5);
+            size_t i = 0;
+            for (; i + W <= numFrames; i += W) {
+                Simd::store(out + i, Simd::mul(Simd::pairSum(data + i * 2), gain));
+            }
+            downmixScalar(data + i * 2, numFrames - i, 2, out + i);
+        } else if (numChannels >= W) {
+            // a frame is one or more vectors (e.g. 8 channels). sum them and the rest.
+            float gain = 1.0 / numChannels;
+            size_t numVectors = numChannels / W;
+            for (size_t i = 0; i < numFrames; ++i) {
+                const float * frame = data + i * numChannels;
+                Vec s = Simd::load(frame);
+                for (size_t v = 1; v < numVectors; ++v) {
+                    s = Simd::add(s, Simd::load(frame + v * W));
+                }
+                float sum = Simd::sum(s);
+                for (size_t c = numVectors * W; c < numChannels; ++c) {
+                    sum += frame[c];
+                }
+                out[i] = sum * gain;
+            }
+        } else {
+            downmixScalar(data, numFrames, numChannels, out);
+        }
+    }
+
+    void toInt16Simd(const float * data, size_t numSamples, int16_t * out) {
+        Vec lo = Simd::set(-1), hi = Simd::set(1), scale = Simd::set(32767);
+        size_t i = 0;
+        for (; i + 2 * W <= numSamples; i += 2 * W) {
+            Vec a = Simd::mul(Simd::min(Simd::max(Simd::load(data + i), lo), hi), scale);
+            Vec b = Simd::mul(Simd::min(Simd::max(Simd::load(data + i + W), lo), hi), scale);
+            Simd::storeInt16(out + i, a, b);
+        }
+        toInt16Scalar(data + i, numSamples - i, out + i);
+    }
+
+    // Interleaved samples repeat the channels every lcm(W, numChannels) samples, so a vector
+    // at a position in this period always holds the same channels.
+    const size_t maxDcPeriod = 256;
+
+    size_t getDcPeriod(size_t numChannels) {
+        size_t period = numChannels;
+        while (period % W != 0) period += numChannels;
+        // at least 4 vectors per loop
+        while (period < 4 * W) period *= 2;
+        return period;
+    }
+
+    void removeDcSimd(float * data, size_t numFrames, size_t numChannels, float * dc, float k) {
+        size_t period = getDcPeriod(numChannels);
+        if (period > maxDcPeriod) {
+            removeDcScalar(data, numFrames, numChannels, dc, k);
+            return;
+        }
+        size_t numVectors = period / W;
+        size_t numSamples = numFrames * numChannels;
+        size_t numPeriods = numSamples / period;
+
+        // sum of each position in the period. a vector position at a time, so the sums stay in registers.
+        float positions[maxDcPeriod];
+        for (size_t v = 0; v < numVectors; ++v) {
+            const float * src = data + v * W;
+            Vec s0 = Simd::set(0), s1 = Simd::set(0);
+            size_t p = 0;
+            for (; p + 2 <= numPeriods; p += 2) {
+                s0 = Simd::add(s0, Simd::load(src + p * period));
+                s1 = Simd::add(s1, Simd::load(src + (p + 1) * period));
+            }
+            if (p < numPeriods) s0 = Simd::add(s0, Simd::load(src + p * period));
+            Simd::store(positions + v * W, Simd::add(s0, s1));
+        }
+
+        // the period and the tail start at channel 0. no division per sample.
+        float sums[maxDcPeriod];
+        std::fill_n(sums, numChannels, 0.0f);
+        for (size_t i = 0, c = 0; i < period; ++i, c = c + 1 < numChannels ? c + 1 : 0) sums[c] += positions[i];
+        for (size_t i = numPeriods * period, c = 0; i < numSamples; ++i, c = c + 1 < numChannels ? c + 1 : 0) sums[c] += data[i];
+        updateDc(sums, numFrames, numChannels, dc, k);
+
+        // offsets in the same layout as the period
+        for (size_t i = 0, c = 0; i < period; ++i, c = c + 1 < numChannels ? c + 1 : 0) positions[i] = dc[c];
+        for (size_t v = 0; v < numVectors; ++v) {
+            float * dst = data + v * W;
+            Vec offset = Simd::load(positions + v * W);
+            for (size_t p = 0; p < numPeriods; ++p) {
+                Simd::store(dst + p * period, Simd::sub(Simd::load(dst + p * period), offset));
+            }
+        }
+        for (size_t i = numPeriods * period, c = 0; i < numSamples; ++i, c = c + 1 < numChannels ? c + 1 : 0) data[i] -= dc[c];
+    }
+#endif
+}
+
+float ofxWhisperDsp::peak(const float * data, size_t numSamples) {
+#ifdef OFXWHISPER_DSP_SIMD
+    if (simdEnabled.load(std::memory_order_relaxed)) return peakSimd(data, numSamples);
+#endif
+    return peakScalar(data, numSamples);
+}
+
+float ofxWhisperDsp::rms(const float * data, size_t numSamples) {
+    if (numSamples == 0) return 0;
+    float sum;
+#ifdef OFXWHISPER_DSP_SIMD
+    if (simdEnabled.load(std::memory_order_relaxed)) sum = sumOfSquaresSimd(data, numSamples);
+    else
+#endif
+    sum = sumOfSquaresScalar(data, numSamples);
+    return sqrt(sum / numSamples);
+}
+
+void ofxWhisperDsp::downmix(const float * data, size_t numFrames, size_t numChannels, float * out) {
+    if (numFrames == 0 || numChannels == 0) return;
+#ifdef OFXWHISPER_DSP_SIMD
+    if (simdEnabled.load(std::memory_order_relaxed)) {
+        downmixSimd(data, numFrames, numChannels, out);
+        return;
+    }
+#endif
+    downmixScalar(data, numFrames, numChannels, out);
+}
+
+void ofxWhisperDsp::toInt16(const float * data, size_t numSamples, int16_t * out) {
+#ifdef OFXWHISPER_DSP_SIMD
+    if (simdEnabled.load(std::memory_order_relaxed)) {
+        toInt16Simd(data, numSamples, out);
+        return;
+    }
+#endif
+    toInt16Scalar(data, numSamples, out);
+}
+
+void ofxWhisperDsp::removeDc(float * data, size_t numFrames, size_t numChannels, float * dc, float k) {
+    if (numFrames == 0 || numChannels == 0) return;
+#ifdef OFXWHISPER_DSP_SIMD
+    if (simdEnabled.load(std::memory_order_relaxed)) {
+        removeDcSimd(data, numFrames, numChannels, dc, k);
+        return;
+    }
+#endif
+    removeDcScalar(data, numFrames, numChannels, dc, k);
+}
+
+string ofxWhisperDsp::getImplementation() {
+#ifdef OFXWHISPER_DSP_SIMD
+    if (simdEnabled) return Simd::name();
+#endif
+    return "scalar";
+}
+
+void ofxWhisperDsp::setSimdEnabled(bool enabled) {
+    simdEnabled = enabled;
+}
+
+bool ofxWhisperDsp::isSimdEnabled() {
+    return simdEnabled;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "ofMain.h"
+
+// Sample kernels of the capture path (level meter, VAD, downmix, wav encoding).
+// Vectorized with AVX2 (built with -mavx2 / -march=native / /arch:AVX2), SSE2 (x86 default)
+// or NEON (ARM), and scalar versions for other targets.
+// Audio is interleaved float. Thread safe.
+class ofxWhisperDsp {
+public:
+    // Max of abs(sample)
+    static float peak(const float * data, size_t numSamples);
+
+    // Root mean square
+    static float rms(const float * data, size_t numSamples);
+
+    // Average of the channels of each frame. out: numFrames samples
+    static void downmix(const float * data, size_t numFrames, size_t numChannels, float * out);
+
+    // Clamped to -1..1 and rounded to 16 bit
+    static void toInt16(const float * data, size_t numSamples, int16_t * out);
+
+    // Subtract the DC offset of each channel in place.
+    // dc: offset of each channel (numChannels), updated with the mean of the block.
+    // k: smoothing of the offset (0-1, 1: mean of this block only)
+    static void removeDc(float * data, size_t numFrames, size_t numChannels, float * dc, float k);
+
+    // "avx2", "sse2", "neon" or "scalar"
+    static string getImplementation();
+
+    // Use the vectorized versions (default:true). false: scalar versions, e.g. to compare them.
+    static void setSimdEnabled(bool enabled);
+    static bool isSimdEnabled();
+};
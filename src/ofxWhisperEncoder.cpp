@@ -0,0 +1,170 @@
+#include "ofxWhisperEncoder.h"
+#include "ofxWhisperDsp.h"
+#ifdef OFXWHISPER_USE_FLAC
+#include "FLAC/stream_encoder.h"
+#endif
+#ifdef OFXWHISPER_USE_OPUS
+#include "opusenc.h"
+#endif
+
+bool ofxWhisperEncoder::encode(const ofSoundBuffer & buffer, Format format, string & data) {
+    switch (format) {
+        case Wav:
+            return encodeWav(buffer, data);
+        case Flac:
+            return encodeFlac(buffer, data);
+        case Opus:
+            return encodeOpus(buffer, data);
+        default:
+            return false;
+    }
+}
+
+bool ofxWhisperEncoder::isAvailable(Format format) {
+    switch (format) {
+        case Wav:
+            return true;
+#ifdef OFXWHISPER_USE_FLAC
+        case Flac:
+            return true;
+#endif
+#ifdef OFXWHISPER_USE_OPUS
+        case Opus:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+string ofxWhisperEncoder::getMimeType(Format format) {
+    switch (format) {
+        case Flac:
+            return "audio/flac";
+        case Opus:
+            return "audio/ogg";
+        default:
+            return "audio/wav";
+    }
+}
+
+string ofxWhisperEncoder::getExtension(Format format) {
+    switch (format) {
+        case Flac:
+            return "flac";
+        case Opus:
+            return "ogg";
+        default:
+            return "wav";
+    }
+}
+
+bool ofxWhisperEncoder::encodeWav(const ofSoundBuffer & buffer, string & wav) {
+    auto & samples = buffer.getBuffer();
+    vector<int16_t> pcm(samples.size());
+    ofxWhisperDsp::toInt16(samples.data(), samples.size(), pcm.data());
+    
+    uint32_t numChannels = buffer.getNumChannels();
+    uint32_t sampleRate = buffer.getSampleRate();
+    uint32_t dataSize = pcm.size() * sizeof(int16_t);
+    uint32_t byteRate = sampleRate * numChannels * sizeof(int16_t);
+    uint16_t blockAlign = numChannels * sizeof(int16_t);
+    
+    auto put32 = [&wav](uint32_t v) {
+        for (int i = 0; i < 4; ++i) wav.push_back((char)((v >> (8 * i)) & 0xff));
+    };
+    auto put16 = [&wav](uint16_t v) {
+        wav.push_back((char)(v & 0xff));
+        wav.push_back((char)((v >> 8) & 0xff));
+    };
+    
+    // RIFF header (little endian)
+    wav.clear();
+    wav.reserve(44 + dataSize);
+    wav += "RIFF";
+    put32(36 + dataSize);
+    wav += "WAVEfmt ";
+    put32(16);
+    put16(1); // PCM
+    put16(numChannels);
+    put32(sampleRate);
+    put32(byteRate);
+    put16(blockAlign);
+    put16(16); // bits per sample
+    wav += "data";
+    put32(dataSize);
+    for (auto s : pcm) {
+        put16((uint16_t)s);
+    }
+    return true;
+}
+
+#ifdef OFXWHISPER_USE_FLAC
+static FLAC__StreamEncoderWriteStatus flacWriteCallback(const FLAC__StreamEncoder * encoder, const FLAC__byte buffer[], size_t bytes, uint32_t samples, uint32_t currentFrame, void * clientData) {
+    static_cast<string *>(clientData)->append((const char *)buffer, bytes);
+    return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+}
+#endif
+
+bool ofxWhisperEncoder::encodeFlac(const ofSoundBuffer & buffer, string & flac) {
+#ifdef OFXWHISPER_USE_FLAC
+    flac.clear();
+    size_t numChannels = buffer.getNumChannels();
+    size_t numFrames = buffer.getNumFrames();
+    
+    FLAC__StreamEncoder * encoder = FLAC__stream_encoder_new();
+    if (!encoder) return false;
+    FLAC__stream_encoder_set_channels(encoder, numChannels);
+    FLAC__stream_encoder_set_bits_per_sample(encoder, 16);
+    FLAC__stream_encoder_set_sample_rate(encoder, buffer.getSampleRate());
+    FLAC__stream_encoder_set_compression_level(encoder, 5);
+    FLAC__stream_encoder_set_total_samples_estimate(encoder, numFrames);
+    
+    bool ok = FLAC__stream_encoder_init_stream(encoder, flacWriteCallback, nullptr, nullptr, nullptr, &flac) == FLAC__STREAM_ENCODER_INIT_STATUS_OK;
+    if (ok) {
+        auto & data = buffer.getBuffer();
+        vector<int16_t> pcm(data.size());
+        ofxWhisperDsp::toInt16(data.data(), data.size(), pcm.data());
+        vector<FLAC__int32> samples(pcm.begin(), pcm.end());
+        ok = FLAC__stream_encoder_process_interleaved(encoder, samples.data(), numFrames);
+        ok = FLAC__stream_encoder_finish(encoder) && ok;
+    }
+    FLAC__stream_encoder_delete(encoder);
+    return ok;
+#else
+    return false;
+#endif
+}
+
+#ifdef OFXWHISPER_USE_OPUS
+static int opusWriteCallback(void * userData, const unsigned char * ptr, opus_int32 len) {
+    static_cast<string *>(userData)->append((const char *)ptr, len);
+    return 0;
+}
+
+static int opusCloseCallback(void * userData) {
+    return 0;
+}
+#endif
+
+bool ofxWhisperEncoder::encodeOpus(const ofSoundBuffer & buffer, string & opus, int bitrate) {
+#ifdef OFXWHISPER_USE_OPUS
+    opus.clear();
+    OpusEncCallbacks callbacks = {opusWriteCallback, opusCloseCallback};
+    OggOpusComments * comments = ope_comments_create();
+    int error = 0;
+    OggOpusEnc * encoder = ope_encoder_create_callbacks(&callbacks, &opus, comments, buffer.getSampleRate(), buffer.getNumChannels(), 0, &error);
+    bool ok = encoder && error == OPE_OK;
+    if (ok) {
+        ope_encoder_ctl(encoder, OPUS_SET_BITRATE(bitrate));
+        ope_encoder_ctl(encoder, OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE));
+        ok = ope_encoder_write_float(encoder, buffer.getBuffer().data(), buffer.getNumFrames()) == OPE_OK;
+        ok = ope_encoder_drain(encoder) == OPE_OK && ok;
+    }
+    if (encoder) ope_encoder_destroy(encoder);
+    ope_comments_destroy(comments);
+    return ok;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "ofMain.h"
+
+// Audio encoder for upload.
+// Flac needs OFXWHISPER_USE_FLAC (libFLAC), Opus needs OFXWHISPER_USE_OPUS (libopusenc).
+class ofxWhisperEncoder {
+public:
+    enum Format {
+        Wav = 0,
+        Flac,
+        Opus
+    };
+    
+    // Return false if the format is not available in this build
+    static bool encode(const ofSoundBuffer & buffer, Format format, string & data);
+    
+    static bool isAvailable(Format format);
+    static string getMimeType(Format format);
+    static string getExtension(Format format);
+    
+    // 16bit PCM wav
+    static bool encodeWav(const ofSoundBuffer & buffer, string & wav);
+    
+    // 16bit FLAC
+    static bool encodeFlac(const ofSoundBuffer & buffer, string & flac);
+    
+    // Ogg Opus (bitrate: bits/sec)
+    static bool encodeOpus(const ofSoundBuffer & buffer, string & opus, int bitrate = 24000);
+};
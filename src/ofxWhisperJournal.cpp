@@ -0,0 +1,325 @@
+#include "ofxWhisperJournal.h"
+#ifdef TARGET_WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+namespace {
+    const char recordMagic[4] = {'O', 'F', 'W', 'J'};
+
+    // FNV-1a
+    uint32_t fnv1a(uint32_t hash, const string & data) {
+        for (unsigned char c : data) {
+            hash = (hash ^ c) * 16777619u;
+        }
+        return hash;
+    }
+}
+
+ofxWhisperJournal::ofxWhisperJournal() {
+}
+
+ofxWhisperJournal::~ofxWhisperJournal() {
+    close();
+}
+
+bool ofxWhisperJournal::setup(string _directory) {
+    close();
+    std::lock_guard<ofMutex> lock(mutex);
+    directory = ofToDataPath(_directory, true);
+    if (!ofDirectory::createDirectory(directory, false, true)) {
+        ofLogError("ofxWhisper") << "Cannot create journal directory " << directory;
+        return false;
+    }
+    if (!load()) return false;
+    ofLogNotice("ofxWhisper") << "Journal " << getPath() << ": " << pending.size() << " pending items";
+
+    // no finished record is needed any more
+    compact(true);
+    return file != nullptr;
+}
+
+void ofxWhisperJournal::close() {
+    std::lock_guard<ofMutex> lock(mutex);
+    if (file) fclose(file);
+    file = nullptr;
+    pending.clear();
+    fileSize = 0;
+    liveBytes = 0;
+    deadBytes = 0;
+}
+
+bool ofxWhisperJournal::isOpen() {
+    std::lock_guard<ofMutex> lock(mutex);
+    return file != nullptr;
+}
+
+uint64_t ofxWhisperJournal::add(const ofJson & meta, const string & data) {
+    std::lock_guard<ofMutex> lock(mutex);
+    if (!file) return 0;
+    uint64_t id = nextId++;
+    uint64_t offset = fileSize;
+    string metaText = meta.dump();
+    if (!writeRecord(Add, id, metaText, data)) return 0;
+    pending[id] = Record{offset, (uint32_t)metaText.size(), (uint32_t)data.size()};
+    liveBytes += fileSize - offset;
+    return id;
+}
+
+void ofxWhisperJournal::markDone(uint64_t id) {
+    std::lock_guard<ofMutex> lock(mutex);
+    auto it = pending.find(id);
+    if (!file || it == pending.end()) return;
+    uint64_t size = sizeof(RecordHeader) + it->second.metaLength + it->second.dataLength;
+    pending.erase(it);
+    liveBytes -= size;
+    deadBytes += size;
+
+    uint64_t offset = fileSize;
+    if (writeRecord(Done, id, "", "")) deadBytes += fileSize - offset;
+    compact(false);
+}
+
+bool ofxWhisperJournal::read(uint64_t id, ofJson & meta, string & data) {
+    std::lock_guard<ofMutex> lock(mutex);
+    auto it = pending.find(id);
+    if (!file || it == pending.end()) return false;
+    auto & record = it->second;
+    string metaText(record.metaLength, '\0');
+    data.resize(record.dataLength);
+    if (fseek(file, record.offset + sizeof(RecordHeader), SEEK_SET) != 0 ||
+        fread(&metaText[0], 1, metaText.size(), file) != metaText.size() ||
+        fread(&data[0], 1, data.size(), file) != data.size()) {
+        ofLogError("ofxWhisper") << "Cannot read journal record " << id;
+        return false;
+    }
+    try {
+        meta = ofJson::parse(metaText);
+    } catch (std::exception & e) {
+        ofLogError("ofxWhisper") << "Broken journal record " << id << ": " << e.what();
+        return false;
+    }
+    return true;
+}
+
+bool ofxWhisperJournal::moveToDeadLetter(uint64_t id) {
+    ofJson meta;
+    string data;
+    if (!read(id, meta, data)) return false;
+    
+    // <id>.json (metadata) and <id>.<ext> (audio, if it is in the record)
+    string deadLetterDirectory = getDeadLetterDirectory();
+    string base = ofFilePath::join(deadLetterDirectory, ofToString(id));
+    bool ok = ofDirectory::createDirectory(deadLetterDirectory, false, true);
+    if (ok && data.size() > 0) {
+        std::ofstream file(base + "." + meta.value("ext", "wav"), std::ios::binary | std::ios::trunc);
+        file.write(data.data(), data.size());
+        ok = (bool)file;
+    }
+    if (ok) {
+        std::ofstream file(base + ".json", std::ios::trunc);
+        file << meta.dump(4);
+        ok = (bool)file;
+    }
+    if (!ok) {
+        ofLogError("ofxWhisper") << "Cannot write " << base;
+        return false;
+    }
+    markDone(id);
+    return true;
+}
+
+vector<uint64_t> ofxWhisperJournal::getPendingIds() {
+    std::lock_guard<ofMutex> lock(mutex);
+    vector<uint64_t> ids;
+    for (auto & record : pending) {
+        ids.push_back(record.first);
+    }
+    return ids;
+}
+
+size_t ofxWhisperJournal::getNumPending() {
+    std::lock_guard<ofMutex> lock(mutex);
+    return pending.size();
+}
+
+string ofxWhisperJournal::getDirectory() const {
+    return directory;
+}
+
+string ofxWhisperJournal::getDeadLetterDirectory() const {
+    return ofFilePath::join(directory, "dead_letter");
+}
+
+bool ofxWhisperJournal::load() {
+    string path = getPath();
+    file = fopen(path.c_str(), "a+b");
+    if (!file) {
+        ofLogError("ofxWhisper") << "Cannot open journal " << path;
+        return false;
+    }
+
+    // records until the first broken one (e.g. cut by a crash)
+    fseek(file, 0, SEEK_SET);
+    uint64_t offset = 0;
+    RecordHeader header;
+    string meta, data;
+    while (fread(&header, sizeof(header), 1, file) == 1) {
+        if (memcmp(header.magic, recordMagic, 4) != 0) break;
+        meta.resize(header.metaLength);
+        data.resize(header.dataLength);
+        if (fread(&meta[0], 1, meta.size(), file) != meta.size()) break;
+        if (fread(&data[0], 1, data.size(), file) != data.size()) break;
+        if (getChecksum(meta, data) != header.checksum) break;
+
+        uint64_t size = sizeof(header) + meta.size() + data.size();
+        if (header.type == Add) {
+            pending[header.id] = Record{offset, header.metaLength, header.dataLength};
+            liveBytes += size;
+        } else if (header.type == Done) {
+            auto it = pending.find(header.id);
+            if (it != pending.end()) {
+                uint64_t addSize = sizeof(header) + it->second.metaLength + it->second.dataLength;
+                liveBytes -= addSize;
+                deadBytes += addSize;
+                pending.erase(it);
+            }
+            deadBytes += size;
+        }
+        nextId = MAX(nextId, header.id + 1);
+        offset += size;
+    }
+    fileSize = offset;
+
+    // the broken tail is dropped by compact() in setup()
+    fseek(file, 0, SEEK_END);
+    if ((uint64_t)ftell(file) != fileSize) {
+        ofLogWarning("ofxWhisper") << "Journal has a broken record at " << fileSize;
+        deadBytes += ftell(file) - fileSize;
+    }
+    return true;
+}
+
+bool ofxWhisperJournal::writeRecord(RecordType type, uint64_t id, const string & meta, const string & data) {
+    RecordHeader header;
+    memcpy(header.magic, recordMagic, 4);
+    header.type = type;
+    header.id = id;
+    header.metaLength = meta.size();
+    header.dataLength = data.size();
+    header.checksum = getChecksum(meta, data);
+    header.reserved = 0;
+
+    // "a+b" always appends
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(meta.data(), 1, meta.size(), file) == meta.size() &&
+        fwrite(data.data(), 1, data.size(), file) == data.size();
+    sync();
+    if (!ok) {
+        ofLogError("ofxWhisper") << "Cannot write journal " << getPath();
+        return false;
+    }
+    fileSize += sizeof(header) + meta.size() + data.size();
+    return true;
+}
+
+void ofxWhisperJournal::sync() {
+    syncFile(file);
+}
+
+bool ofxWhisperJournal::syncFile(FILE * f) {
+    if (fflush(f) != 0) return false;
+#ifdef TARGET_WIN32
+    return _commit(_fileno(f)) == 0;
+#else
+    return fsync(fileno(f)) == 0;
+#endif
+}
+
+void ofxWhisperJournal::syncDirectory() {
+#ifndef TARGET_WIN32
+    // the rename is durable when the directory entry is on disk
+    int fd = open(directory.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    fsync(fd);
+    ::close(fd);
+#endif
+}
+
+void ofxWhisperJournal::compact(bool force) {
+    if (!file || deadBytes == 0) return;
+    if (!force && !pending.empty() && deadBytes < liveBytes) return;
+
+    // rewrite the pending records to a new file and replace the journal
+    string path = getPath();
+    string tmpPath = path + ".tmp";
+    FILE * tmp = fopen(tmpPath.c_str(), "wb");
+    if (!tmp) {
+        ofLogError("ofxWhisper") << "Cannot write " << tmpPath;
+        return;
+    }
+    map<uint64_t, Record> compacted;
+    uint64_t offset = 0;
+    vector<char> buffer;
+    bool ok = true;
+    for (auto & record : pending) {
+        size_t size = sizeof(RecordHeader) + record.second.metaLength + record.second.dataLength;
+        buffer.resize(size);
+        ok = fseek(file, record.second.offset, SEEK_SET) == 0 &&
+            fread(buffer.data(), 1, size, file) == size &&
+            fwrite(buffer.data(), 1, size, tmp) == size;
+        if (!ok) break;
+        compacted[record.first] = Record{offset, record.second.metaLength, record.second.dataLength};
+        offset += size;
+    }
+    // the new file is on disk before it replaces the journal
+    ok = syncFile(tmp) && ok;
+    ok = fclose(tmp) == 0 && ok;
+    if (!ok) {
+        ofLogError("ofxWhisper") << "Journal compaction failed";
+        ofFile::removeFile(tmpPath, false);
+        return;
+    }
+
+    fclose(file);
+    file = nullptr;
+    bool moved = ofFile::moveFromTo(tmpPath, path, false, true);
+    if (moved) {
+        syncDirectory();
+    } else {
+        ofLogError("ofxWhisper") << "Cannot replace " << path;
+        ofFile::removeFile(tmpPath, false);
+    }
+    file = fopen(path.c_str(), "a+b");
+    if (!file) {
+        ofLogError("ofxWhisper") << "Cannot open journal " << path;
+        pending.clear();
+        return;
+    }
+    fseek(file, 0, SEEK_END);
+    fileSize = ftell(file);
+    if (moved && fileSize == offset) {
+        pending.swap(compacted);
+        liveBytes = offset;
+        deadBytes = 0;
+    } else if (moved) {
+        // neither the old nor the new offsets are valid
+        ofLogError("ofxWhisper") << "Journal " << path << " has unexpected size after compaction. " << pending.size() << " pending items are lost";
+        pending.clear();
+        liveBytes = 0;
+        deadBytes = fileSize;
+    } else {
+        // the old file is still there
+        deadBytes = fileSize - liveBytes;
+    }
+}
+
+string ofxWhisperJournal::getPath() const {
+    return ofFilePath::join(directory, "journal.bin");
+}
+
+uint32_t ofxWhisperJournal::getChecksum(const string & meta, const string & data) {
+    return fnv1a(fnv1a(2166136261u, meta), data);
+}
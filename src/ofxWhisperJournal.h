@@ -0,0 +1,74 @@
+#pragma once
+#include "ofMain.h"
+
+// Write-ahead journal of queued audio (see ofxWhisper::setJournal()).
+// journal.bin is append-only. An Add record (metadata + encoded audio) is written and flushed
+// before the item is queued, and a Done record when it is finished. Records after a crash
+// are checked by length and checksum, so a cut record at the end is ignored.
+// The file is rewritten without finished records when they take more than half of it.
+// Items given up for good are moved to the dead_letter directory (audio + json) for inspection.
+// Thread safe.
+class ofxWhisperJournal {
+public:
+    ofxWhisperJournal();
+    ~ofxWhisperJournal();
+
+    // directory: relative to data path. Existing records are loaded.
+    bool setup(string directory);
+    void close();
+    bool isOpen();
+
+    // Return record id (0: failed)
+    uint64_t add(const ofJson & meta, const string & data);
+    void markDone(uint64_t id);
+    bool read(uint64_t id, ofJson & meta, string & data);
+    // Write the record to the dead_letter directory and mark it done
+    bool moveToDeadLetter(uint64_t id);
+
+    // Ids of records which are not done (oldest first)
+    vector<uint64_t> getPendingIds();
+    size_t getNumPending();
+
+    string getDirectory() const;
+    string getDeadLetterDirectory() const;
+
+private:
+    enum RecordType {
+        Add = 1,
+        Done = 2,
+    };
+    struct RecordHeader {
+        char magic[4];
+        uint32_t type;
+        uint64_t id;
+        uint32_t metaLength;
+        uint32_t dataLength;
+        uint32_t checksum;
+        uint32_t reserved;
+    };
+    struct Record {
+        uint64_t offset;
+        uint32_t metaLength, dataLength;
+    };
+
+    ofMutex mutex;
+    string directory;
+    FILE * file = nullptr;
+    uint64_t fileSize = 0;
+    uint64_t nextId = 1;
+    map<uint64_t, Record> pending;
+    // bytes of Add records in pending and the rest of the file
+    uint64_t liveBytes = 0, deadBytes = 0;
+
+    bool load();
+    bool writeRecord(RecordType type, uint64_t id, const string & meta, const string & data);
+    void sync();
+    // fflush and fsync. Return false on error
+    static bool syncFile(FILE * f);
+    void syncDirectory();
+    // Rewrite without finished records if they are more than the pending ones (or force)
+    void compact(bool force);
+    string getPath() const;
+
+    static uint32_t getChecksum(const string & meta, const string & data);
+};
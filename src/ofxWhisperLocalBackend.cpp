@@ -0,0 +1,148 @@
+#include "ofxWhisperLocalBackend.h"
+#include "ofxAudioFile.h"
+#include "ofxWhisperResampler.h"
+#ifdef OFXWHISPER_USE_WHISPER_CPP
+#include "whisper.h"
+#endif
+
+// whisper.cpp input sample rate
+static const int localSampleRate = 16000;
+
+void ofxWhisperLocalBackend::toMono16k(const float * data, size_t numFrames, size_t numChannels, int sampleRate, vector<float> & pcm) {
+    pcm.clear();
+    if (numFrames == 0 || numChannels == 0 || sampleRate <= 0) return;
+    ofxWhisperResampler::toMono(data, numFrames, numChannels, sampleRate, localSampleRate, pcm);
+}
+
+ofxWhisperLocalBackend::ofxWhisperLocalBackend(string modelPath, int numThreads) : modelPath(modelPath), numThreads(MAX(1, numThreads)) {
+}
+
+ofxWhisperLocalBackend::~ofxWhisperLocalBackend() {
+#ifdef OFXWHISPER_USE_WHISPER_CPP
+    if (context) whisper_free(context);
+#endif
+}
+
+bool ofxWhisperLocalBackend::setup() {
+#ifdef OFXWHISPER_USE_WHISPER_CPP
+    if (context) return true;
+    
+    auto params = whisper_context_default_params();
+    context = whisper_init_from_file_with_params(ofToDataPath(modelPath).c_str(), params);
+    if (!context) {
+        ofLogError("ofxWhisper") << "Failed to load whisper model " << modelPath;
+        return false;
+    }
+    return true;
+#else
+    ofLogError("ofxWhisper") << "Local backend is disabled. Build with OFXWHISPER_USE_WHISPER_CPP.";
+    return false;
+#endif
+}
+
+ofxWhisperBackend::Result ofxWhisperLocalBackend::transcribe(const Request & request) {
+    Result result;
+#ifdef OFXWHISPER_USE_WHISPER_CPP
+    if (!context) {
+        result.errorCode = ofxWhisper::InvalidModel;
+        return result;
+    }
+    
+    vector<float> pcm;
+    if (!loadPcm(request, pcm)) {
+        result.errorCode = ofxWhisper::BadRequest;
+        return result;
+    }
+    
+    auto params = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
+    params.n_threads = numThreads;
+    params.print_progress = false;
+    params.print_realtime = false;
+    params.print_timestamps = false;
+    params.print_special = false;
+    params.no_context = true;
+    params.language = request.language != "" ? request.language.c_str() : "auto";
+    if (request.prompt != "") {
+        params.initial_prompt = request.prompt.c_str();
+    }
+    params.token_timestamps = wordTimestamps;
+    
+    std::lock_guard<ofMutex> lock(contextMutex);
+    if (whisper_full(context, params, pcm.data(), (int)pcm.size()) != 0) {
+        ofLogError("ofxWhisper") << "whisper_full failed";
+        return result;
+    }
+    
+    // timestamps are in 10ms
+    whisper_token eot = whisper_token_eot(context);
+    int numSegments = whisper_full_n_segments(context);
+    for (int i = 0; i < numSegments; ++i) {
+        ofxWhisper::TranscriptSegment segment;
+        segment.text = whisper_full_get_segment_text(context, i);
+        segment.start = whisper_full_get_segment_t0(context, i) * 0.01f;
+        segment.end = whisper_full_get_segment_t1(context, i) * 0.01f;
+        segment.noSpeechProbability = whisper_full_get_segment_no_speech_prob(context, i);
+        result.text += segment.text;
+        segment.text = ofTrim(segment.text);
+        
+        // mean log probability of text tokens (special tokens are after eot)
+        float logprob = 0;
+        int numTokens = 0;
+        for (int j = 0, n = whisper_full_n_tokens(context, i); j < n; ++j) {
+            auto token = whisper_full_get_token_data(context, i, j);
+            if (token.id >= eot) continue;
+            logprob += token.plog;
+            numTokens++;
+            
+            // a token starting with a space begins a word
+            if (wordTimestamps) {
+                string text = whisper_full_get_token_text(context, i, j);
+                if (result.words.empty() || (text.size() > 0 && text[0] == ' ')) {
+                    result.words.push_back(ofxWhisper::TranscriptWord());
+                    result.words.back().start = token.t0 * 0.01f;
+                }
+                result.words.back().word += text;
+                result.words.back().end = token.t1 * 0.01f;
+            }
+        }
+        if (numTokens > 0) segment.confidence = exp(logprob / numTokens);
+        result.segments.push_back(segment);
+    }
+    for (auto & word : result.words) {
+        word.word = ofTrim(word.word);
+    }
+    result.text = ofTrim(result.text);
+    result.language = whisper_lang_str(whisper_full_lang_id(context));
+    result.duration = (float)pcm.size() / WHISPER_SAMPLE_RATE;
+    result.rawResponse = result.text;
+    result.errorCode = ofxWhisper::Success;
+#else
+    result.errorCode = ofxWhisper::InvalidModel;
+#endif
+    return result;
+}
+
+void ofxWhisperLocalBackend::setWordTimestamps(bool enabled) {
+    wordTimestamps = enabled;
+}
+
+bool ofxWhisperLocalBackend::isWordTimestamps() const {
+    return wordTimestamps;
+}
+
+bool ofxWhisperLocalBackend::loadPcm(const Request & request, vector<float> & pcm) {
+    if (request.buffer.size() > 0) {
+        auto & buffer = request.buffer;
+        toMono16k(buffer.getBuffer().data(), buffer.getNumFrames(), buffer.getNumChannels(), buffer.getSampleRate(), pcm);
+        return !pcm.empty();
+    }
+    
+    ofxAudioFile audioFile;
+    audioFile.load(request.filePath);
+    if (!audioFile.loaded()) {
+        ofLogError("ofxWhisper") << "Failed to decode " << request.filePath;
+        return false;
+    }
+    toMono16k(audioFile.data(), audioFile.length(), audioFile.channels(), audioFile.samplerate(), pcm);
+    return !pcm.empty();
+}
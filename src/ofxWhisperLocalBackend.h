@@ -0,0 +1,37 @@
+#pragma once
+#include "ofxWhisperBackend.h"
+
+struct whisper_context;
+
+// Offline in-process inference with whisper.cpp (GGML model)
+// Define OFXWHISPER_USE_WHISPER_CPP and link whisper.cpp to enable it.
+class ofxWhisperLocalBackend : public ofxWhisperBackend {
+public:
+    // modelPath: ggml model file. e.g. "ggml-tiny.en.bin"
+    ofxWhisperLocalBackend(string modelPath, int numThreads = 4);
+    ~ofxWhisperLocalBackend();
+    
+    bool setup() override;
+    Result transcribe(const Request & request) override;
+    string getName() const override { return "whisper.cpp"; }
+    string getModel() const override { return ofFilePath::getFileName(modelPath); }
+    
+    // Word timestamps from token timestamps (default:false)
+    void setWordTimestamps(bool enabled);
+    bool isWordTimestamps() const;
+    
+    // Decode request audio to 16kHz mono float (whisper.cpp input format)
+    static bool loadPcm(const Request & request, vector<float> & pcm);
+    
+    // Downmix interleaved audio and resample it to 16kHz
+    static void toMono16k(const float * data, size_t numFrames, size_t numChannels, int sampleRate, vector<float> & pcm);
+    
+private:
+    string modelPath;
+    int numThreads;
+    bool wordTimestamps = false;
+    
+    // whisper_context does not allow parallel inference
+    ofMutex contextMutex;
+    whisper_context * context = nullptr;
+};
@@ -0,0 +1,301 @@
+#include "ofxWhisperOpenAIBackend.h"
+#include "Poco/Net/HTTPClientSession.h"
+#include "Poco/Net/HTTPSClientSession.h"
+#include "Poco/Net/HTTPRequest.h"
+#include "Poco/Net/HTTPResponse.h"
+#include "Poco/Net/HTMLForm.h"
+#include "Poco/Net/StringPartSource.h"
+#include "Poco/Net/FilePartSource.h"
+#include "Poco/Net/Context.h"
+#include "Poco/Net/SSLManager.h"
+#include "Poco/URI.h"
+#include "Poco/Exception.h"
+#include "Poco/Net/NetException.h"
+#include "Poco/StreamCopier.h"
+#include "Poco/CountingStream.h"
+
+ofxWhisperOpenAIBackend::ofxWhisperOpenAIBackend(string api_key) : apiKey(api_key) {
+    setEndpoint("https://api.openai.com/v1/audio/transcriptions");
+    setModel("whisper-1");
+}
+
+ofxWhisperOpenAIBackend::~ofxWhisperOpenAIBackend() {
+    closeIdleSessions();
+}
+
+bool ofxWhisperOpenAIBackend::setup() {
+    Poco::Net::initializeSSL();
+    if (apiKey == "") {
+        ofLogError("ofxWhisper") << "OpenAI api key is empty";
+        return false;
+    }
+    return true;
+}
+
+void ofxWhisperOpenAIBackend::setEndpoint(string url) {
+    sessionMutex.lock();
+    endpoint = url;
+    sessionMutex.unlock();
+    
+    // connections to the old endpoint are not reused
+    closeIdleSessions();
+}
+
+string ofxWhisperOpenAIBackend::getEndpoint() const {
+    std::lock_guard<ofMutex> lock(sessionMutex);
+    return endpoint;
+}
+
+void ofxWhisperOpenAIBackend::setModel(string _model) {
+    model = _model;
+}
+
+string ofxWhisperOpenAIBackend::getModel() const {
+    return model;
+}
+
+void ofxWhisperOpenAIBackend::setVerbose(bool enabled) {
+    verbose = enabled;
+}
+
+bool ofxWhisperOpenAIBackend::isVerbose() const {
+    return verbose;
+}
+
+void ofxWhisperOpenAIBackend::setWordTimestamps(bool enabled) {
+    wordTimestamps = enabled;
+}
+
+bool ofxWhisperOpenAIBackend::isWordTimestamps() const {
+    return wordTimestamps;
+}
+
+void ofxWhisperOpenAIBackend::setTimeout(float sec) {
+    timeout = MAX(1, sec);
+}
+
+float ofxWhisperOpenAIBackend::getTimeout() const {
+    return timeout;
+}
+
+void ofxWhisperOpenAIBackend::setIdleTimeout(float sec) {
+    idleTimeout = MAX(0, sec);
+}
+
+float ofxWhisperOpenAIBackend::getIdleTimeout() const {
+    return idleTimeout;
+}
+
+int ofxWhisperOpenAIBackend::getNumConnections() const {
+    return numConnections;
+}
+
+ofxWhisperBackend::Result ofxWhisperOpenAIBackend::transcribe(const Request & request) {
+    Result result;
+    ofxHttpResponse response = submit(request, result);
+    
+    result.rawResponse = response.responseBody.getText();
+    result.errorCode = ofxWhisper::parseErrorResponse(response);
+    
+    if (result.errorCode == ofxWhisper::Success) {
+        uint64_t parseStartTime = ofGetElapsedTimeMicros();
+        if (!parseVerboseJson(result.rawResponse, result)) {
+            result.errorCode = ofxWhisper::UnknownError;
+        }
+        result.parseTime = (ofGetElapsedTimeMicros() - parseStartTime) * 0.001;
+    }
+    return result;
+}
+
+unique_ptr<Poco::Net::HTTPClientSession> ofxWhisperOpenAIBackend::acquireSession(const string & url, bool & reused) {
+    uint64_t now = ofGetElapsedTimeMillis();
+    std::lock_guard<ofMutex> lock(sessionMutex);
+    
+    // the newest idle connection which is not timed out
+    while (!idleSessions.empty()) {
+        IdleSession idle = std::move(idleSessions.back());
+        idleSessions.pop_back();
+        if (idle.endpoint == url && now - idle.lastUsed < idleTimeout * 1000) {
+            reused = true;
+            return std::move(idle.session);
+        }
+    }
+    
+    reused = false;
+    Poco::URI uri(url);
+    unique_ptr<Poco::Net::HTTPClientSession> session;
+    if (uri.getScheme() == "https") {
+        // created after initializeSSL() in setup()
+        if (!context) {
+            context = new Poco::Net::Context(Poco::Net::Context::CLIENT_USE, "", "", "", Poco::Net::Context::VERIFY_RELAXED, 9, true);
+        }
+        session.reset(new Poco::Net::HTTPSClientSession(uri.getHost(), uri.getPort(), context));
+    } else {
+        session.reset(new Poco::Net::HTTPClientSession(uri.getHost(), uri.getPort()));
+    }
+    session->setKeepAlive(true);
+    session->setKeepAliveTimeout(Poco::Timespan(idleTimeout, 0));
+    session->setTimeout(Poco::Timespan(timeout, 0));
+    numConnections++;
+    return session;
+}
+
+void ofxWhisperOpenAIBackend::releaseSession(unique_ptr<Poco::Net::HTTPClientSession> session, const string & url) {
+    std::lock_guard<ofMutex> lock(sessionMutex);
+    // not kept if the endpoint was changed meanwhile
+    if (idleSessions.size() >= maxIdleSessions || url != endpoint) return;
+    IdleSession idle;
+    idle.session = std::move(session);
+    idle.endpoint = url;
+    idle.lastUsed = ofGetElapsedTimeMillis();
+    idleSessions.push_back(std::move(idle));
+}
+
+void ofxWhisperOpenAIBackend::closeIdleSessions() {
+    std::lock_guard<ofMutex> lock(sessionMutex);
+    idleSessions.clear();
+}
+
+ofxHttpResponse ofxWhisperOpenAIBackend::submit(const Request & request, Result & result) {
+    ofxHttpResponse response;
+    
+    auto format = request.format;
+    string data;
+    if (request.buffer.size() > 0 && !ofxWhisperEncoder::encode(request.buffer, format, data)) {
+        ofLogWarning("ofxWhisper") << ofxWhisperEncoder::getExtension(format) << " encoder is not available. Upload wav.";
+        format = ofxWhisperEncoder::Wav;
+        ofxWhisperEncoder::encode(request.buffer, format, data);
+    }
+    
+    string url = getEndpoint();
+    
+    // A reused connection may have been closed by the server while it was idle. Writing to it
+    // usually succeeds and the close is found when the response is read. Then reconnect once,
+    // only if the server gave no response at all (see isConnectionClosed()).
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        bool reused = false;
+        bool responseStarted = false;
+        unique_ptr<Poco::Net::HTTPClientSession> session;
+        try {
+            session = acquireSession(url, reused);
+            
+            Poco::URI uri(url);
+            Poco::Net::HTTPRequest httpRequest(Poco::Net::HTTPRequest::HTTP_POST, uri.getPathAndQuery(), Poco::Net::HTTPMessage::HTTP_1_1);
+            httpRequest.set("Authorization", "Bearer " + apiKey);
+            httpRequest.setKeepAlive(true);
+            
+            Poco::Net::HTMLForm form(Poco::Net::HTMLForm::ENCODING_MULTIPART);
+            form.set("model", model);
+            if (request.prompt != "") {
+                form.set("prompt", request.prompt);
+            }
+            if (request.language != "") {
+                form.set("language", request.language);
+            }
+            if (verbose) {
+                form.set("response_format", "verbose_json");
+                form.add("timestamp_granularities[]", "segment");
+                if (wordTimestamps) {
+                    form.add("timestamp_granularities[]", "word");
+                }
+            }
+            if (request.buffer.size() > 0) {
+                form.addPart("file", new Poco::Net::StringPartSource(data, ofxWhisperEncoder::getMimeType(format), "recording." + ofxWhisperEncoder::getExtension(format)));
+            } else {
+                form.addPart("file", new Poco::Net::FilePartSource(ofToDataPath(request.filePath)));
+            }
+            form.prepareSubmit(httpRequest);
+            try {
+                httpRequest.setContentLength(form.calculateContentLength());
+                httpRequest.setChunkedTransferEncoding(false);
+            }
+            catch (Poco::Exception &) {
+                // unknown length. send chunked.
+            }
+            Poco::CountingOutputStream requestStream(session->sendRequest(httpRequest));
+            form.write(requestStream);
+            requestStream.flush();
+            result.bytesSent = requestStream.chars();
+            
+            Poco::Net::HTTPResponse pocoResponse;
+            std::istream & rs = session->receiveResponse(pocoResponse);
+            responseStarted = true;
+            string body;
+            Poco::StreamCopier::copyToString(rs, body);
+            
+            response.status = pocoResponse.getStatus();
+            response.reasonForStatus = pocoResponse.getReason();
+            response.contentType = pocoResponse.getContentType();
+            response.responseBody.set(body);
+            
+            // rate limit headers for the retry scheduler
+            if (pocoResponse.has("Retry-After")) {
+                result.retryAfter = ofToFloat(pocoResponse.get("Retry-After"));
+            }
+            if (pocoResponse.has("x-ratelimit-remaining-requests")) {
+                result.rateLimitRemaining = ofToInt(pocoResponse.get("x-ratelimit-remaining-requests"));
+            }
+            if (pocoResponse.has("x-ratelimit-reset-requests")) {
+                result.rateLimitReset = parseDuration(pocoResponse.get("x-ratelimit-reset-requests"));
+            }
+            if (pocoResponse.has("openai-processing-ms")) {
+                result.serverTime = ofToFloat(pocoResponse.get("openai-processing-ms"));
+            }
+            
+            if (pocoResponse.getKeepAlive()) {
+                releaseSession(std::move(session), url);
+            }
+            return response;
+        }
+        catch (Poco::TimeoutException & e) {
+            ofLogError("ofxWhisper") << "Upload timeout: " << e.displayText();
+            response.status = 408;
+            return response;
+        }
+        catch (Poco::Exception & e) {
+            if (reused && attempt == 0 && !responseStarted && isConnectionClosed(e)) {
+                ofLogVerbose("ofxWhisper") << "Reconnect: " << e.displayText();
+                continue;
+            }
+            ofLogError("ofxWhisper") << "Upload failed: " << e.displayText();
+            response.status = -1;
+            return response;
+        }
+    }
+    return response;
+}
+
+bool ofxWhisperOpenAIBackend::isConnectionClosed(const Poco::Exception & e) {
+    // closed without reading the request: no response (NoMessageException), reset or broken pipe
+    return dynamic_cast<const Poco::Net::NoMessageException *>(&e) ||
+        dynamic_cast<const Poco::Net::ConnectionResetException *>(&e) ||
+        dynamic_cast<const Poco::Net::ConnectionAbortedException *>(&e);
+}
+
+float ofxWhisperOpenAIBackend::parseDuration(const string & text) {
+    // e.g. "1s", "6m0s", "20ms", "1h2m3.5s"
+    float sec = 0;
+    string number;
+    for (size_t i = 0; i < text.size(); ++i) {
+        char c = text[i];
+        if (isdigit((unsigned char)c) || c == '.') {
+            number += c;
+            continue;
+        }
+        float value = ofToFloat(number);
+        number = "";
+        if (c == 'h') {
+            sec += value * 3600;
+        } else if (c == 'm' && i + 1 < text.size() && text[i + 1] == 's') {
+            sec += value / 1000;
+            ++i;
+        } else if (c == 'm') {
+            sec += value * 60;
+        } else if (c == 's') {
+            sec += value;
+        }
+    }
+    // plain number is seconds
+    if (number != "") sec += ofToFloat(number);
+    return sec;
+}
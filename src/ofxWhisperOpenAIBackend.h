@@ -0,0 +1,82 @@
+#pragma once
+#include "ofxWhisperBackend.h"
+#include "Poco/Net/Context.h"
+
+namespace Poco { class Exception; namespace Net { class HTTPClientSession; } }
+
+// OpenAI Whisper API (HTTP)
+// Keep-alive connections to the endpoint are pooled and reused across requests. A request which
+// failed on a reused connection is sent again only if the server closed it without a response.
+class ofxWhisperOpenAIBackend : public ofxWhisperBackend {
+public:
+    ofxWhisperOpenAIBackend(string api_key);
+    ~ofxWhisperOpenAIBackend();
+    
+    bool setup() override;
+    Result transcribe(const Request & request) override;
+    string getName() const override { return "OpenAI"; }
+    
+    // Endpoint url (default: https://api.openai.com/v1/audio/transcriptions)
+    // http:// is also available (e.g. local mock server for testing)
+    void setEndpoint(string url);
+    string getEndpoint() const;
+    
+    // Model name (default: whisper-1)
+    void setModel(string _model);
+    string getModel() const override;
+    
+    // Request verbose_json (language, duration and segment timestamps) (default:true)
+    // gpt-4o-transcribe models support only json. Set false for them.
+    void setVerbose(bool enabled);
+    bool isVerbose() const;
+    
+    // Request word timestamps too (default:false). Needs verbose.
+    void setWordTimestamps(bool enabled);
+    bool isWordTimestamps() const;
+    
+    // Request timeout (sec, default:60)
+    void setTimeout(float sec);
+    float getTimeout() const;
+    
+    // Idle connections are closed after this time (sec, default:30)
+    void setIdleTimeout(float sec);
+    float getIdleTimeout() const;
+    
+    // Num of connections opened so far (less than requests if connections are reused)
+    int getNumConnections() const;
+    
+    // Parse duration of x-ratelimit-reset-* (e.g. "6m0s") to sec
+    static float parseDuration(const string & text);
+    
+private:
+    // OpenAI key
+    string apiKey;
+    string endpoint;
+    string model;
+    bool verbose = true;
+    bool wordTimestamps = false;
+    float timeout = 60;
+    float idleTimeout = 30;
+    
+    // Connection pool (endpoint and the pool: sessionMutex).
+    // One TLS context is shared by the https connections.
+    struct IdleSession {
+        unique_ptr<Poco::Net::HTTPClientSession> session;
+        string endpoint;
+        uint64_t lastUsed;
+    };
+    vector<IdleSession> idleSessions;
+    Poco::Net::Context::Ptr context;
+    mutable ofMutex sessionMutex;
+    std::atomic<int> numConnections{0};
+    static const size_t maxIdleSessions = 8;
+    unique_ptr<Poco::Net::HTTPClientSession> acquireSession(const string & url, bool & reused);
+    void releaseSession(unique_ptr<Poco::Net::HTTPClientSession> session, const string & url);
+    void closeIdleSessions();
+    
+    // Post audio as multipart form. Buffer is encoded in memory. no temp file.
+    // Rate limit headers are stored in result.
+    ofxHttpResponse submit(const Request & request, Result & result);
+    // The server closed the connection before it responded (reconnect is safe on a reused one)
+    static bool isConnectionClosed(const Poco::Exception & e);
+};
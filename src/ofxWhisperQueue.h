@@ -0,0 +1,98 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Bounded lock-free multi producer / multi consumer queue (Vyukov).
+// Every cell has a sequence number, so producers and consumers only contend on the
+// head / tail index. Capacity is rounded up to a power of 2. No allocation after allocate().
+template<typename T>
+class ofxWhisperQueue {
+public:
+    ofxWhisperQueue(size_t capacity = 0) {
+        allocate(capacity);
+    }
+
+    // Not thread safe. Call it before the producers and consumers start.
+    void allocate(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        cells = std::vector<Cell>(size);
+        for (size_t i = 0; i < size; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        mask = size - 1;
+        head = 0;
+        tail = 0;
+    }
+
+    size_t getCapacity() const {
+        return cells.size();
+    }
+
+    // Return false if the queue is full (value is not moved)
+    bool tryPush(T && value) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        Cell * cell;
+        while (true) {
+            cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Return false if the queue is empty
+    bool tryPop(T & value) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        Cell * cell;
+        while (true) {
+            cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+        value = std::move(cell->value);
+        cell->value = T();
+        cell->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Approximate while producers or consumers are running
+    size_t size() const {
+        size_t t = tail.load(std::memory_order_acquire);
+        size_t h = head.load(std::memory_order_acquire);
+        return t > h ? t - h : 0;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence{0};
+        T value;
+    };
+    std::vector<Cell> cells;
+    size_t mask = 0;
+    // separate cache lines for producers and consumers
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
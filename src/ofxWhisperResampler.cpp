@@ -0,0 +1,153 @@
+#include "ofxWhisperResampler.h"
+#include "ofxWhisperDsp.h"
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define OFXWHISPER_RESAMPLER_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define OFXWHISPER_RESAMPLER_NEON
+#endif
+
+static int gcd(int a, int b) {
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// zeroth order modified Bessel function (for Kaiser window)
+static double besselI0(double x) {
+    double sum = 1, term = 1;
+    for (int k = 1; k < 32; ++k) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+static inline float dot(const float * a, const float * b, size_t n) {
+    size_t i = 0;
+    float sum = 0;
+#if defined(OFXWHISPER_RESAMPLER_SSE)
+    __m128 acc = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4) {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(OFXWHISPER_RESAMPLER_NEON)
+    float32x4_t acc = vdupq_n_f32(0);
+    for (; i + 4 <= n; i += 4) {
+        acc = vmlaq_f32(acc, vld1q_f32(a + i), vld1q_f32(b + i));
+    }
+    float32x2_t half = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    sum = vget_lane_f32(vpadd_f32(half, half), 0);
+#endif
+    for (; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+ofxWhisperResampler::ofxWhisperResampler() {
+}
+
+ofxWhisperResampler::ofxWhisperResampler(int inRate, int outRate, int tapsPerPhase) {
+    setup(inRate, outRate, tapsPerPhase);
+}
+
+void ofxWhisperResampler::setup(int inRate, int outRate, int tapsPerPhase) {
+    int g = gcd(MAX(1, inRate), MAX(1, outRate));
+    up = MAX(1, outRate) / g;
+    down = MAX(1, inRate) / g;
+    taps = MAX(4, tapsPerPhase);
+    
+    // prototype low pass at the upsampled rate.
+    // odd length so that the delay is an integer in upsampled time.
+    size_t length = (size_t)up * taps - 1;
+    double cutoff = 0.5 / MAX(up, down) * 0.92;
+    double center = (length - 1) * 0.5;
+    double beta = 8.0;
+    double i0Beta = besselI0(beta);
+    vector<double> prototype(length);
+    for (size_t n = 0; n < length; ++n) {
+        double x = n - center;
+        double sinc = x == 0 ? 2 * cutoff : sin(TWO_PI * cutoff * x) / (PI * x);
+        double r = 2.0 * n / (length - 1) - 1.0;
+        double kaiser = besselI0(beta * sqrt(MAX(0.0, 1 - r * r))) / i0Beta;
+        prototype[n] = sinc * kaiser * up;
+    }
+    
+    // polyphase split. coeffs[p][j] multiplies x[i - (taps - 1) + j]
+    coeffs.assign((size_t)up * taps, 0);
+    for (int p = 0; p < up; ++p) {
+        for (int j = 0; j < taps; ++j) {
+            size_t n = p + (size_t)(taps - 1 - j) * up;
+            coeffs[p * taps + j] = n < length ? prototype[n] : 0;
+        }
+    }
+    reset();
+}
+
+void ofxWhisperResampler::reset() {
+    work.assign(taps - 1, 0);
+    time = 0;
+}
+
+void ofxWhisperResampler::process(const float * in, size_t numSamples, vector<float> & out) {
+    if (coeffs.empty()) return;
+    work.resize(taps - 1);
+    work.insert(work.end(), in, in + numSamples);
+    
+    out.reserve(out.size() + numSamples * up / down + 1);
+    while (true) {
+        uint64_t index = time / up;
+        if (index >= numSamples) break;
+        int phase = time % up;
+        out.push_back(dot(coeffs.data() + phase * taps, work.data() + index, taps));
+        time += down;
+    }
+    
+    // keep the history and rebase the time to the next input
+    time -= (uint64_t)numSamples * up;
+    work.erase(work.begin(), work.end() - (taps - 1));
+}
+
+void ofxWhisperResampler::resample(const float * in, size_t numSamples, int inRate, int outRate, vector<float> & out) {
+    out.clear();
+    if (inRate == outRate) {
+        out.assign(in, in + numSamples);
+        return;
+    }
+    
+    ofxWhisperResampler resampler(inRate, outRate);
+    size_t expected = (size_t)((uint64_t)numSamples * outRate / inRate);
+    
+    // start at the filter delay so that the first output is aligned to the first input
+    resampler.time = (uint64_t)resampler.up * resampler.taps / 2 - 1;
+    
+    resampler.process(in, numSamples, out);
+    vector<float> tail(resampler.taps, 0);
+    resampler.process(tail.data(), tail.size(), out);
+    if (out.size() > expected) out.resize(expected);
+}
+
+void ofxWhisperResampler::toMono(const float * data, size_t numFrames, size_t numChannels, int inRate, int outRate, vector<float> & out) {
+    if (numChannels <= 1) {
+        resample(data, numFrames, inRate, outRate, out);
+        return;
+    }
+    
+    vector<float> mono(numFrames);
+    ofxWhisperDsp::downmix(data, numFrames, numChannels, mono.data());
+    resample(mono.data(), numFrames, inRate, outRate, out);
+}
+
+void ofxWhisperResampler::toMono(const ofSoundBuffer & in, int outRate, ofSoundBuffer & out) {
+    vector<float> samples;
+    toMono(in.getBuffer().data(), in.getNumFrames(), in.getNumChannels(), in.getSampleRate(), outRate, samples);
+    out.copyFrom(samples.data(), samples.size(), 1, outRate);
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "ofMain.h"
+
+// Polyphase FIR resampler (Kaiser windowed sinc) for mono float audio.
+// e.g. 48000 -> 16000 for Whisper
+class ofxWhisperResampler {
+public:
+    ofxWhisperResampler();
+    ofxWhisperResampler(int inRate, int outRate, int tapsPerPhase = 32);
+    
+    void setup(int inRate, int outRate, int tapsPerPhase = 32);
+    
+    // Streaming. Resampled samples are appended to out.
+    void process(const float * in, size_t numSamples, vector<float> & out);
+    
+    // Forget the history
+    void reset();
+    
+    // Resample whole mono audio (delay compensated)
+    static void resample(const float * in, size_t numSamples, int inRate, int outRate, vector<float> & out);
+    
+    // Downmix interleaved audio to mono and resample it
+    static void toMono(const float * data, size_t numFrames, size_t numChannels, int inRate, int outRate, vector<float> & out);
+    static void toMono(const ofSoundBuffer & in, int outRate, ofSoundBuffer & out);
+    
+private:
+    // up / down factors
+    int up = 1, down = 1;
+    int taps = 32;
+    
+    // coefficients [phase][tap], ordered to match the input history
+    vector<float> coeffs;
+    
+    // history (taps - 1) + current input
+    vector<float> work;
+    
+    // position of the next output in upsampled time, relative to the current input
+    uint64_t time = 0;
+};
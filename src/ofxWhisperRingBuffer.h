@@ -0,0 +1,131 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+// Lock-free single producer / single consumer ring buffer.
+// write() is called from one thread (e.g. audio callback) and read() from another.
+// No allocation after allocate().
+template<typename T>
+class ofxWhisperRingBuffer {
+public:
+    ofxWhisperRingBuffer(size_t capacity = 0) {
+        allocate(capacity);
+    }
+    
+    // Not thread safe. Call it before the producer and consumer start.
+    void allocate(size_t capacity) {
+        buffer.assign(capacity + 1, T());
+        writeIndex = 0;
+        readIndex = 0;
+    }
+    
+    size_t getCapacity() const {
+        return buffer.size() - 1;
+    }
+    
+    // Producer. Return num of written elements (less than num if the buffer is full)
+    size_t write(const T * data, size_t num) {
+        size_t size = buffer.size();
+        size_t w = writeIndex.load(std::memory_order_relaxed);
+        size_t r = readIndex.load(std::memory_order_acquire);
+        num = std::min(num, (r + size - w - 1) % size);
+        
+        size_t first = std::min(num, size - w);
+        std::copy(data, data + first, buffer.data() + w);
+        std::copy(data + first, data + num, buffer.data());
+        writeIndex.store((w + num) % size, std::memory_order_release);
+        return num;
+    }
+    
+    // Consumer. Return num of read elements
+    size_t read(T * data, size_t num) {
+        size_t size = buffer.size();
+        size_t r = readIndex.load(std::memory_order_relaxed);
+        size_t w = writeIndex.load(std::memory_order_acquire);
+        num = std::min(num, (w + size - r) % size);
+        
+        size_t first = std::min(num, size - r);
+        std::copy(buffer.data() + r, buffer.data() + r + first, data);
+        std::copy(buffer.data(), buffer.data() + num - first, data + first);
+        readIndex.store((r + num) % size, std::memory_order_release);
+        return num;
+    }
+    
+    // Consumer. Drop everything written so far
+    void clear() {
+        readIndex.store(writeIndex.load(std::memory_order_acquire), std::memory_order_release);
+    }
+    
+    size_t getNumReadable() const {
+        size_t size = buffer.size();
+        return (writeIndex.load(std::memory_order_acquire) + size - readIndex.load(std::memory_order_acquire)) % size;
+    }
+    
+    size_t getNumWritable() const {
+        return getCapacity() - getNumReadable();
+    }
+    
+private:
+    std::vector<T> buffer;
+    std::atomic<size_t> writeIndex{0}, readIndex{0};
+};
+
+// Keeps the latest elements written (older ones are overwritten). e.g. pre-roll audio.
+// Single thread. No allocation after allocate().
+template<typename T>
+class ofxWhisperHistoryBuffer {
+public:
+    ofxWhisperHistoryBuffer(size_t capacity = 0) {
+        allocate(capacity);
+    }
+    
+    void allocate(size_t capacity) {
+        buffer.assign(capacity, T());
+        writeIndex = 0;
+        numElements = 0;
+    }
+    
+    size_t getCapacity() const {
+        return buffer.size();
+    }
+    
+    size_t getSize() const {
+        return numElements;
+    }
+    
+    void write(const T * data, size_t num) {
+        size_t size = buffer.size();
+        if (size == 0) return;
+        if (num >= size) {
+            // only the tail is kept
+            std::copy(data + num - size, data + num, buffer.data());
+            writeIndex = 0;
+            numElements = size;
+            return;
+        }
+        size_t first = std::min(num, size - writeIndex);
+        std::copy(data, data + first, buffer.data() + writeIndex);
+        std::copy(data + first, data + num, buffer.data());
+        writeIndex = (writeIndex + num) % size;
+        numElements = std::min(size, numElements + num);
+    }
+    
+    // Copy getSize() elements to data (oldest first)
+    void copyTo(T * data) const {
+        size_t size = buffer.size();
+        size_t start = (writeIndex + size - numElements) % std::max<size_t>(size, 1);
+        size_t first = std::min(numElements, size - start);
+        std::copy(buffer.data() + start, buffer.data() + start + first, data);
+        std::copy(buffer.data(), buffer.data() + numElements - first, data + first);
+    }
+    
+    void clear() {
+        writeIndex = 0;
+        numElements = 0;
+    }
+    
+private:
+    std::vector<T> buffer;
+    size_t writeIndex = 0, numElements = 0;
+};
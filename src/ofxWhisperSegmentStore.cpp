@@ -0,0 +1,194 @@
+#include "ofxWhisperSegmentStore.h"
+#include "Poco/Path.h"
+#ifdef TARGET_LINUX
+#include <sys/vfs.h>
+#include <linux/magic.h>
+#endif
+
+namespace {
+    bool isRamFileSystem(const string & path) {
+#ifdef TARGET_LINUX
+        struct statfs info;
+        if (statfs(path.c_str(), &info) != 0) return false;
+        return info.f_type == TMPFS_MAGIC || info.f_type == RAMFS_MAGIC;
+#else
+        return false;
+#endif
+    }
+
+    string withSlash(string path) {
+        if (!path.empty() && path.back() != '/' && path.back() != '\\') path += "/";
+        return path;
+    }
+}
+
+ofxWhisperSegmentStore::~ofxWhisperSegmentStore() {
+    clear();
+}
+
+bool ofxWhisperSegmentStore::setup(Type _type, size_t _maxBytes, string parent) {
+    clear();
+    std::lock_guard<ofMutex> lock(mutex);
+    type = _type;
+    maxBytes = _maxBytes;
+    ramBacked = false;
+
+    if (parent == "") {
+        parent = type == Memory ? getRamDirectory() : getTempDirectory();
+        if (parent == "") {
+            ofLogWarning("ofxWhisper") << "No RAM-backed directory on this platform";
+            return false;
+        }
+    } else {
+        parent = ofToDataPath(parent, true);
+    }
+    ramBacked = isRamFileSystem(parent);
+    if (type == Memory && !ramBacked) {
+        ofLogWarning("ofxWhisper") << parent << " is not RAM-backed";
+    }
+    return createDirectory(parent);
+}
+
+ofxWhisperSegmentStore::Type ofxWhisperSegmentStore::getType() const {
+    return type;
+}
+
+bool ofxWhisperSegmentStore::isRamBacked() const {
+    return ramBacked;
+}
+
+string ofxWhisperSegmentStore::getDirectory() {
+    std::lock_guard<ofMutex> lock(mutex);
+    if (directory == "") createDirectory(getTempDirectory());
+    return directory;
+}
+
+string ofxWhisperSegmentStore::createPath(const string & prefix, const string & extension) {
+    static std::atomic<uint64_t> counter{0};
+    return getDirectory() + prefix + "_" + ofToString(counter++) + "." + extension;
+}
+
+void ofxWhisperSegmentStore::commit(const string & path) {
+    size_t size = ofFile(path).getSize();
+    vector<string> evicted;
+    {
+        std::lock_guard<ofMutex> lock(mutex);
+        files.push_back(Segment{path, size, false});
+        numBytes += size;
+
+        // oldest first. pinned files are in use, and the new file is kept even if it is larger than the budget.
+        auto last = std::prev(files.end());
+        for (auto it = files.begin(); it != last && maxBytes > 0 && numBytes > maxBytes;) {
+            if (it->pinned) {
+                ++it;
+                continue;
+            }
+            evicted.push_back(it->path);
+            numBytes -= it->size;
+            it = files.erase(it);
+        }
+    }
+    for (auto & p : evicted) {
+        ofLogWarning("ofxWhisper") << "Segment store is full. Evict " << p;
+        ofFile::removeFile(p, false);
+        numEvicted++;
+    }
+}
+
+void ofxWhisperSegmentStore::pin(const string & path) {
+    std::lock_guard<ofMutex> lock(mutex);
+    auto it = find(path);
+    if (it != files.end()) it->pinned = true;
+}
+
+void ofxWhisperSegmentStore::release(const string & path) {
+    {
+        std::lock_guard<ofMutex> lock(mutex);
+        auto it = find(path);
+        if (it == files.end()) return;
+        numBytes -= it->size;
+        files.erase(it);
+    }
+    ofFile::removeFile(path, false);
+}
+
+void ofxWhisperSegmentStore::evict(const string & path) {
+    ofLogWarning("ofxWhisper") << "Segment store is full. Evict " << path;
+    release(path);
+    numEvicted++;
+}
+
+bool ofxWhisperSegmentStore::contains(const string & path) {
+    std::lock_guard<ofMutex> lock(mutex);
+    return directory != "" && path.compare(0, directory.size(), directory) == 0;
+}
+
+bool ofxWhisperSegmentStore::isOverBudget() {
+    std::lock_guard<ofMutex> lock(mutex);
+    return maxBytes > 0 && numBytes > maxBytes;
+}
+
+size_t ofxWhisperSegmentStore::getNumBytes() {
+    std::lock_guard<ofMutex> lock(mutex);
+    return numBytes;
+}
+
+size_t ofxWhisperSegmentStore::getNumFiles() {
+    std::lock_guard<ofMutex> lock(mutex);
+    return files.size();
+}
+
+size_t ofxWhisperSegmentStore::getMaxBytes() const {
+    return maxBytes;
+}
+
+int ofxWhisperSegmentStore::getNumEvicted() const {
+    return numEvicted;
+}
+
+void ofxWhisperSegmentStore::clear() {
+    std::lock_guard<ofMutex> lock(mutex);
+    if (directory != "" && ofDirectory::doesDirectoryExist(directory, false)) {
+        ofDirectory::removeDirectory(directory, true, false);
+    }
+    directory = "";
+    files.clear();
+    numBytes = 0;
+}
+
+string ofxWhisperSegmentStore::getTempDirectory() {
+#ifdef _CS_DARWIN_USER_TEMP_DIR
+    // per user temp directory on macOS
+    char tempPath[PATH_MAX];
+    size_t tempPathSize = confstr(_CS_DARWIN_USER_TEMP_DIR, tempPath, sizeof(tempPath));
+    if (tempPathSize > 0 && tempPathSize <= sizeof(tempPath)) return withSlash(tempPath);
+#endif
+    // TMPDIR / TMP / TEMP, GetTempPath() on Windows, /tmp
+    return withSlash(Poco::Path::temp());
+}
+
+string ofxWhisperSegmentStore::getRamDirectory() {
+    vector<string> candidates = {ofGetEnv("XDG_RUNTIME_DIR"), "/dev/shm"};
+    for (auto & path : candidates) {
+        if (path != "" && isRamFileSystem(path)) return withSlash(path);
+    }
+    return "";
+}
+
+list<ofxWhisperSegmentStore::Segment>::iterator ofxWhisperSegmentStore::find(const string & path) {
+    return std::find_if(files.begin(), files.end(), [&path](const Segment & f) {
+        return f.path == path;
+    });
+}
+
+bool ofxWhisperSegmentStore::createDirectory(const string & parent) {
+    // a directory per instance, so instances don't delete the files of the others
+    static std::atomic<int> numInstances{0};
+    string path = withSlash(parent) + "ofxWhisper/" + ofToString(ofGetSystemTimeMillis()) + "_" + ofToString(numInstances++) + "/";
+    if (!ofDirectory::createDirectory(path, false, true)) {
+        ofLogError("ofxWhisper") << "Cannot create " << path;
+        return false;
+    }
+    directory = path;
+    return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "ofMain.h"
+
+// Storage of recorded segment files (wav) until they are transcribed.
+// Disk: a directory in the system temp directory (TMPDIR, %TEMP%, /tmp ...).
+// Memory: a RAM-backed tmpfs directory (XDG_RUNTIME_DIR or /dev/shm on Linux),
+// so segments never hit persistent storage (e.g. SD cards of embedded devices).
+// Every instance has its own subdirectory, which is deleted by clear().
+// Thread safe.
+class ofxWhisperSegmentStore {
+public:
+    enum Type {
+        Disk,
+        Memory,
+    };
+
+    ~ofxWhisperSegmentStore();
+
+    // maxBytes: budget of the stored files (0: unlimited). The oldest files which are not pinned
+    // are evicted when it is exceeded.
+    // directory: parent directory instead of the default one ("").
+    // Return false if the directory can not be created, or no RAM-backed directory is found for Memory.
+    bool setup(Type type = Disk, size_t maxBytes = 0, string directory = "");
+
+    Type getType() const;
+    bool isRamBacked() const;
+    // With trailing slash. The default Disk store is set up on first use.
+    string getDirectory();
+
+    // Path of a new file in the store
+    string createPath(const string & prefix, const string & extension);
+    // The file is written. Its size is counted and old files are evicted to fit the budget.
+    void commit(const string & path);
+    // The file is used by a queued or in flight item. It is not evicted until it is released.
+    void pin(const string & path);
+    // The file is not needed any more. It is deleted.
+    void release(const string & path);
+    // Release a file to make room (counted by getNumEvicted())
+    void evict(const string & path);
+    bool contains(const string & path);
+    // Stored files are larger than maxBytes
+    bool isOverBudget();
+
+    size_t getNumBytes();
+    size_t getNumFiles();
+    size_t getMaxBytes() const;
+    int getNumEvicted() const;
+
+    // Delete all files and the directory
+    void clear();
+
+    // System temp directory (with trailing slash)
+    static string getTempDirectory();
+    // RAM-backed directory. "" if there is none on this platform.
+    static string getRamDirectory();
+
+private:
+    ofMutex mutex;
+    Type type = Disk;
+    bool ramBacked = false;
+    string directory;
+    size_t maxBytes = 0, numBytes = 0;
+    std::atomic<int> numEvicted{0};
+    // committed files, oldest first
+    struct Segment {
+        string path;
+        size_t size;
+        bool pinned;
+    };
+    list<Segment> files;
+    list<Segment>::iterator find(const string & path);
+
+    bool createDirectory(const string & parent);
+};
@@ -0,0 +1,213 @@
+#include "ofxWhisperStats.h"
+
+namespace {
+    const double bucketMin = 0.001;
+    const int bucketsPerOctave = 4;
+
+    // atomic<double> has no fetch_add before C++20
+    void atomicAdd(std::atomic<double> & target, double value) {
+        double current = target.load(std::memory_order_relaxed);
+        while (!target.compare_exchange_weak(current, current + value, std::memory_order_relaxed));
+    }
+
+    void atomicMin(std::atomic<double> & target, double value) {
+        double current = target.load(std::memory_order_relaxed);
+        while (value < current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed));
+    }
+
+    void atomicMax(std::atomic<double> & target, double value) {
+        double current = target.load(std::memory_order_relaxed);
+        while (value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed));
+    }
+}
+
+ofxWhisperHistogram::ofxWhisperHistogram() {
+    reset();
+}
+
+void ofxWhisperHistogram::record(double value) {
+    value = MAX(0, value);
+    buckets[getBucket(value)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    atomicMin(min, value);
+    atomicMax(max, value);
+    atomicAdd(sum, value);
+}
+
+void ofxWhisperHistogram::reset() {
+    for (auto & bucket : buckets) {
+        bucket = 0;
+    }
+    count = 0;
+    sum = 0;
+    min = std::numeric_limits<double>::max();
+    max = 0;
+}
+
+ofxWhisperHistogram::Summary ofxWhisperHistogram::getSummary() const {
+    Summary summary;
+    uint64_t counts[numBuckets];
+    uint64_t total = 0;
+    for (int i = 0; i < numBuckets; ++i) {
+        counts[i] = buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    summary.count = total;
+    if (total == 0) return summary;
+
+    summary.sum = sum;
+    summary.mean = summary.sum / total;
+    summary.min = min;
+    summary.max = max;
+
+    // linear interpolation in the bucket, clamped to min/max
+    auto percentile = [&](double p) {
+        double target = p * total;
+        uint64_t accumulated = 0;
+        for (int i = 0; i < numBuckets; ++i) {
+            if (counts[i] == 0) continue;
+            if (accumulated + counts[i] >= target) {
+                double lower = i == 0 ? 0 : getBucketBound(i - 1);
+                double upper = getBucketBound(i);
+                double value = lower + (upper - lower) * (target - accumulated) / counts[i];
+                return MIN(MAX(value, summary.min), summary.max);
+            }
+            accumulated += counts[i];
+        }
+        return summary.max;
+    };
+    summary.p50 = percentile(0.5);
+    summary.p90 = percentile(0.9);
+    summary.p99 = percentile(0.99);
+    return summary;
+}
+
+int ofxWhisperHistogram::getBucket(double value) {
+    if (value <= bucketMin) return 0;
+    int bucket = ceil(log2(value / bucketMin) * bucketsPerOctave);
+    return MIN(bucket, numBuckets - 1);
+}
+
+double ofxWhisperHistogram::getBucketBound(int bucket) {
+    return bucketMin * pow(2.0, (double)bucket / bucketsPerOctave);
+}
+
+vector<pair<string, const ofxWhisperHistogram *>> ofxWhisperStats::getHistograms() const {
+    return {
+        {"audio_callback_ms", &audioCallback},
+        {"capture_ms", &capture},
+        {"silence_wait_ms", &silenceWait},
+        {"wav_finalize_ms", &wavFinalize},
+        {"file_wait_ms", &fileWait},
+        {"prepare_ms", &prepare},
+        {"queue_wait_ms", &queueWait},
+        {"request_ms", &request},
+        {"server_ms", &server},
+        {"parse_ms", &parse},
+        {"latency_ms", &latency},
+        {"queue_depth", &queueDepth},
+    };
+}
+
+ofxWhisperStats::Snapshot ofxWhisperStats::getSnapshot() const {
+    Snapshot snapshot;
+    snapshot.time = ofGetSystemTimeMillis();
+    for (auto & h : getHistograms()) {
+        snapshot.histograms[h.first] = h.second->getSummary();
+    }
+    snapshot.counters["requests_total"] = numRequests;
+    snapshot.counters["succeeded_total"] = numSucceeded;
+    snapshot.counters["failed_total"] = numFailed;
+    snapshot.counters["cache_hits_total"] = numCacheHits;
+    snapshot.counters["uploaded_bytes_total"] = bytesUploaded;
+    snapshot.counters["audio_ms_total"] = audioMillis;
+    snapshot.counters["capture_overruns_total"] = numOverruns;
+    snapshot.counters["capture_dropped_samples_total"] = droppedSamples;
+    snapshot.counters["queue_dropped_total"] = numQueueDropped;
+    snapshot.counters["queue_merged_total"] = numQueueMerged;
+    snapshot.counters["transcripts_dropped_total"] = numTranscriptsDropped;
+    snapshot.counters["speculative_total"] = numSpeculative;
+    snapshot.counters["speculative_discarded_total"] = numSpeculativeDiscarded;
+    snapshot.counters["audio_blocks_dropped_total"] = numAudioBlocksDropped;
+    return snapshot;
+}
+
+void ofxWhisperStats::reset() {
+    for (auto & h : getHistograms()) {
+        const_cast<ofxWhisperHistogram *>(h.second)->reset();
+    }
+    numRequests = 0;
+    numSucceeded = 0;
+    numFailed = 0;
+    numCacheHits = 0;
+    bytesUploaded = 0;
+    audioMillis = 0;
+    numOverruns = 0;
+    droppedSamples = 0;
+    numQueueDropped = 0;
+    numQueueMerged = 0;
+    numTranscriptsDropped = 0;
+    numSpeculative = 0;
+    numSpeculativeDiscarded = 0;
+    numAudioBlocksDropped = 0;
+}
+
+ofJson ofxWhisperStats::Snapshot::toJson() const {
+    ofJson json;
+    json["time"] = time;
+    for (auto & c : counters) {
+        json["counters"][c.first] = c.second;
+    }
+    for (auto & h : histograms) {
+        auto & s = h.second;
+        ofJson j;
+        j["count"] = s.count;
+        j["sum"] = s.sum;
+        j["mean"] = s.mean;
+        j["min"] = s.min;
+        j["max"] = s.max;
+        j["p50"] = s.p50;
+        j["p90"] = s.p90;
+        j["p99"] = s.p99;
+        json["histograms"][h.first] = j;
+    }
+    return json;
+}
+
+string ofxWhisperStats::Snapshot::toPrometheus(const string & prefix) const {
+    stringstream ss;
+    for (auto & c : counters) {
+        string name = prefix + "_" + c.first;
+        ss << "# TYPE " << name << " counter\n";
+        ss << name << " " << c.second << "\n";
+    }
+    for (auto & h : histograms) {
+        string name = prefix + "_" + h.first;
+        auto & s = h.second;
+        ss << "# TYPE " << name << " summary\n";
+        ss << name << "{quantile=\"0.5\"} " << s.p50 << "\n";
+        ss << name << "{quantile=\"0.9\"} " << s.p90 << "\n";
+        ss << name << "{quantile=\"0.99\"} " << s.p99 << "\n";
+        ss << name << "_sum " << s.sum << "\n";
+        ss << name << "_count " << s.count << "\n";
+    }
+    return ss.str();
+}
+
+bool ofxWhisperStats::save(const Snapshot & snapshot, const string & path) {
+    string absolutePath = ofToDataPath(path, true);
+    string tmpPath = absolutePath + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::trunc);
+        if (ofToLower(ofFilePath::getFileExt(path)) == "json") {
+            file << snapshot.toJson().dump(2);
+        } else {
+            file << snapshot.toPrometheus();
+        }
+        if (!file) {
+            ofLogError("ofxWhisper") << "Cannot write stats " << tmpPath;
+            return false;
+        }
+    }
+    return ofFile::moveFromTo(tmpPath, absolutePath, false, true);
+}
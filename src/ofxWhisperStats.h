@@ -0,0 +1,94 @@
+#pragma once
+#include "ofMain.h"
+
+// Histogram with log spaced buckets (4 per octave, 0.001 - 4e6).
+// record() is lock free, so it can be called from the audio thread.
+// Percentiles are approximated from the buckets (about 10% error).
+class ofxWhisperHistogram {
+public:
+    ofxWhisperHistogram();
+
+    void record(double value);
+    void reset();
+
+    struct Summary {
+        uint64_t count = 0;
+        double sum = 0, mean = 0, min = 0, max = 0;
+        double p50 = 0, p90 = 0, p99 = 0;
+    };
+    Summary getSummary() const;
+
+    static const int numBuckets = 128;
+
+private:
+    std::array<std::atomic<uint64_t>, numBuckets> buckets;
+    std::atomic<uint64_t> count{0};
+    std::atomic<double> sum{0}, min{0}, max{0};
+
+    static int getBucket(double value);
+    static double getBucketBound(int bucket);
+};
+
+// Stage timers and counters of ofxWhisper. All times are in ms.
+class ofxWhisperStats {
+public:
+    // Audio thread
+    ofxWhisperHistogram audioCallback;
+    // Capture thread. VAD, pre-roll and recording of a block
+    ofxWhisperHistogram capture;
+    // Silence before the end of realtime recording (rrSilenceTimeMax)
+    ofxWhisperHistogram silenceWait;
+    // stopRecording() -> wav file is written
+    ofxWhisperHistogram wavFinalize;
+    // Polling for the recorded file
+    ofxWhisperHistogram fileWait;
+    // Decode, resample and cache lookup before the request
+    ofxWhisperHistogram prepare;
+    // Queued -> request start
+    ofxWhisperHistogram queueWait;
+    // Request (upload + server + response)
+    ofxWhisperHistogram request;
+    // Processing time reported by the server
+    ofxWhisperHistogram server;
+    // Response parse
+    ofxWhisperHistogram parse;
+    // Capture end (or queued) -> transcript delivered
+    ofxWhisperHistogram latency;
+    // Num of items in audioQue (sampled when it changes)
+    ofxWhisperHistogram queueDepth;
+
+    std::atomic<uint64_t> numRequests{0}, numSucceeded{0}, numFailed{0};
+    std::atomic<uint64_t> numCacheHits{0};
+    std::atomic<uint64_t> bytesUploaded{0};
+    // audio sent to the backend
+    std::atomic<uint64_t> audioMillis{0};
+    // capture ring buffer overflows (xrun) and dropped samples
+    std::atomic<uint64_t> numOverruns{0}, droppedSamples{0};
+    // upload queue overflow (see ofxWhisper::setMaxQueueSize()) and transcripts not read by the app
+    std::atomic<uint64_t> numQueueDropped{0}, numQueueMerged{0}, numTranscriptsDropped{0};
+    // speculative uploads and the ones discarded because speech started again
+    std::atomic<uint64_t> numSpeculative{0}, numSpeculativeDiscarded{0};
+    // captured blocks not published to audio subscribers because the pool was exhausted
+    std::atomic<uint64_t> numAudioBlocksDropped{0};
+
+    // Copy of the values at a time
+    struct Snapshot {
+        uint64_t time = 0;
+        map<string, ofxWhisperHistogram::Summary> histograms;
+        map<string, uint64_t> counters;
+
+        ofJson toJson() const;
+        // Prometheus text exposition format
+        string toPrometheus(const string & prefix = "ofxwhisper") const;
+    };
+    Snapshot getSnapshot() const;
+
+    void reset();
+
+    // Write a snapshot to file. Format by extension (.json or Prometheus text).
+    // The file is replaced atomically (e.g. for the node_exporter textfile collector).
+    static bool save(const Snapshot & snapshot, const string & path);
+
+private:
+    vector<pair<string, const ofxWhisperHistogram *>> getHistograms() const;
+};
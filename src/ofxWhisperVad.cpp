@@ -0,0 +1,226 @@
+#include "ofxWhisperVad.h"
+#include "ofxWhisperDsp.h"
+#ifdef OFXWHISPER_USE_WHISPER_CPP
+#include "whisper.h"
+#endif
+
+// ofxWhisperEnergyVad
+
+float ofxWhisperEnergyVad::process(const ofSoundBuffer & buffer) {
+    size_t numFrames = buffer.getNumFrames();
+    size_t numChannels = buffer.getNumChannels();
+    if (numFrames == 0 || numChannels == 0) return probability;
+    
+    // fft size is the power of 2 not less than the block
+    size_t fftSize = 1;
+    while (fftSize < numFrames) fftSize <<= 1;
+    if (mono.size() != numFrames || re.size() != fftSize) {
+        mono.assign(numFrames, 0);
+        re.assign(fftSize, 0);
+        im.assign(fftSize, 0);
+        window.resize(numFrames);
+        for (size_t i = 0; i < numFrames; ++i) {
+            window[i] = 0.5 - 0.5 * cos(TWO_PI * i / MAX(1, numFrames - 1));
+        }
+    }
+    
+    ofxWhisperDsp::downmix(buffer.getBuffer().data(), numFrames, numChannels, mono.data());
+    
+    // energy and zero crossing rate
+    float rms = ofxWhisperDsp::rms(mono.data(), numFrames);
+    size_t crossings = 0;
+    for (size_t i = 1; i < numFrames; ++i) {
+        crossings += (mono[i - 1] < 0) != (mono[i] < 0);
+    }
+    float energyDb = 10 * log10(rms * rms + 1e-10);
+    float zcr = (float)crossings / numFrames * buffer.getSampleRate() / 16000.;
+    
+    // spectral flatness. 1 for white noise, near 0 for voiced sound
+    for (size_t i = 0; i < fftSize; ++i) {
+        re[i] = i < numFrames ? mono[i] * window[i] : 0;
+        im[i] = 0;
+    }
+    fft(re, im);
+    double logSum = 0, sum = 0;
+    size_t numBins = fftSize / 2;
+    for (size_t i = 1; i <= numBins; ++i) {
+        double power = re[i] * re[i] + im[i] * im[i] + 1e-12;
+        logSum += log(power);
+        sum += power;
+    }
+    float flatness = exp(logSum / numBins) / (sum / numBins);
+    
+    if (!initialized) {
+        noiseFloor = energyDb;
+        initialized = true;
+    }
+    
+    // scores
+    float snr = energyDb - noiseFloor;
+    float snrScore = ofClamp((snr - minSnr * 0.5) / minSnr, 0, 1);
+    float flatnessScore = ofClamp((0.6 - flatness) / 0.4, 0, 1);
+    // speech zcr is about 0.02-0.3 at 16kHz
+    float zcrScore = zcr < 0.02 ? zcr / 0.02 : (zcr > 0.3 ? ofClamp(1 - (zcr - 0.3) / 0.2, 0, 1) : 1);
+    float frameProbability = snrScore * (0.4 + 0.6 * flatnessScore) * (0.6 + 0.4 * zcrScore);
+    
+    // smoothing. a single loud block is not speech.
+    float blockTime = (float)numFrames / buffer.getSampleRate();
+    float attack = ofClamp(blockTime / 0.06, 0, 1);
+    float release = ofClamp(blockTime / 0.15, 0, 1);
+    float k = frameProbability > probability ? attack : release;
+    probability += (frameProbability - probability) * k;
+    
+    // adaptive noise floor. falls fast, rises slowly while there is no speech.
+    if (energyDb < noiseFloor) {
+        noiseFloor += (energyDb - noiseFloor) * ofClamp(blockTime / 0.1, 0, 1);
+    } else if (probability < 0.5) {
+        noiseFloor += (energyDb - noiseFloor) * ofClamp(blockTime / noiseAdaptTime, 0, 1);
+    }
+    
+    return probability;
+}
+
+void ofxWhisperEnergyVad::reset() {
+    initialized = false;
+    probability = 0;
+}
+
+void ofxWhisperEnergyVad::setMinSnr(float db) {
+    minSnr = MAX(1, db);
+}
+
+float ofxWhisperEnergyVad::getMinSnr() const {
+    return minSnr;
+}
+
+void ofxWhisperEnergyVad::setNoiseAdaptTime(float sec) {
+    noiseAdaptTime = MAX(0.1, sec);
+}
+
+float ofxWhisperEnergyVad::getNoiseAdaptTime() const {
+    return noiseAdaptTime;
+}
+
+float ofxWhisperEnergyVad::getNoiseFloor() const {
+    return noiseFloor;
+}
+
+// In place radix-2 FFT. size must be power of 2.
+void ofxWhisperEnergyVad::fft(vector<float> & re, vector<float> & im) {
+    size_t n = re.size();
+    for (size_t i = 1, j = 0; i < n; ++i) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) {
+            std::swap(re[i], re[j]);
+            std::swap(im[i], im[j]);
+        }
+    }
+    for (size_t len = 2; len <= n; len <<= 1) {
+        double angle = -TWO_PI / len;
+        float wRe = cos(angle), wIm = sin(angle);
+        for (size_t i = 0; i < n; i += len) {
+            float curRe = 1, curIm = 0;
+            for (size_t j = 0; j < len / 2; ++j) {
+                size_t a = i + j, b = i + j + len / 2;
+                float tRe = re[b] * curRe - im[b] * curIm;
+                float tIm = re[b] * curIm + im[b] * curRe;
+                re[b] = re[a] - tRe;
+                im[b] = im[a] - tIm;
+                re[a] += tRe;
+                im[a] += tIm;
+                float nextRe = curRe * wRe - curIm * wIm;
+                curIm = curRe * wIm + curIm * wRe;
+                curRe = nextRe;
+            }
+        }
+    }
+}
+
+// ofxWhisperNeuralVad
+
+// Silero window at 16kHz
+static const size_t neuralVadWindow = 512;
+// windows the model runs over for each new window (128ms)
+static const size_t neuralVadContext = 4;
+
+ofxWhisperNeuralVad::ofxWhisperNeuralVad(string modelPath) : modelPath(modelPath) {
+}
+
+ofxWhisperNeuralVad::~ofxWhisperNeuralVad() {
+#ifdef OFXWHISPER_USE_WHISPER_CPP
+    if (context) whisper_vad_free(context);
+#endif
+}
+
+bool ofxWhisperNeuralVad::setup() {
+#ifdef OFXWHISPER_USE_WHISPER_CPP
+    if (context) return true;
+    auto params = whisper_vad_default_context_params();
+    params.n_threads = 1;
+    context = whisper_vad_init_from_file_with_params(ofToDataPath(modelPath).c_str(), params);
+    if (!context) {
+        ofLogError("ofxWhisper") << "Failed to load VAD model " << modelPath;
+        return false;
+    }
+    pending.reserve(neuralVadWindow * 4);
+    history.assign(neuralVadWindow * neuralVadContext, 0);
+    return true;
+#else
+    ofLogError("ofxWhisper") << "Neural VAD is disabled. Build with OFXWHISPER_USE_WHISPER_CPP.";
+    return false;
+#endif
+}
+
+float ofxWhisperNeuralVad::process(const ofSoundBuffer & buffer) {
+#ifdef OFXWHISPER_USE_WHISPER_CPP
+    if (!context) return 0;
+    size_t numFrames = buffer.getNumFrames();
+    size_t numChannels = buffer.getNumChannels();
+    if (numFrames == 0 || numChannels == 0) return probability;
+    
+    int sampleRate = buffer.getSampleRate();
+    if (sampleRate != inputRate) {
+        resampler.setup(sampleRate, 16000);
+        inputRate = sampleRate;
+    }
+    
+    // the buffers keep their capacity, so only the first blocks allocate
+    const float * data = buffer.getBuffer().data();
+    if (numChannels > 1) {
+        if (mono.size() < numFrames) mono.resize(numFrames);
+        ofxWhisperDsp::downmix(data, numFrames, numChannels, mono.data());
+        data = mono.data();
+    }
+    resampled.clear();
+    resampler.process(data, numFrames, resampled);
+    pending.insert(pending.end(), resampled.begin(), resampled.end());
+    
+    // run the model for every full window
+    size_t offset = 0;
+    while (pending.size() - offset >= neuralVadWindow) {
+        // slide the context by one window
+        std::copy(history.begin() + neuralVadWindow, history.end(), history.begin());
+        std::copy(pending.begin() + offset, pending.begin() + offset + neuralVadWindow, history.end() - neuralVadWindow);
+        numHistory = MIN(numHistory + 1, neuralVadContext);
+        offset += neuralVadWindow;
+        
+        size_t numSamples = numHistory * neuralVadWindow;
+        if (whisper_vad_detect_speech(context, history.data() + history.size() - numSamples, numSamples)) {
+            int numProbs = whisper_vad_n_probs(context);
+            if (numProbs > 0) probability = whisper_vad_probs(context)[numProbs - 1];
+        }
+    }
+    pending.erase(pending.begin(), pending.begin() + offset);
+#endif
+    return probability;
+}
+
+void ofxWhisperNeuralVad::reset() {
+    pending.clear();
+    std::fill(history.begin(), history.end(), 0);
+    numHistory = 0;
+    resampler.reset();
+    probability = 0;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include "ofMain.h"
+#include "ofxWhisperResampler.h"
+
+struct whisper_vad_context;
+
+// Voice activity detector for realtime recording.
+// process() is called from the capture thread for every captured block.
+class ofxWhisperVad {
+public:
+    virtual ~ofxWhisperVad() {}
+    
+    // Return speech probability (0-1) of the block
+    virtual float process(const ofSoundBuffer & buffer) = 0;
+    
+    // Forget the state (noise floor etc.)
+    virtual void reset() {}
+    
+    virtual string getName() const = 0;
+};
+
+// Energy + zero crossing rate + spectral flatness with an adaptive noise floor.
+// Loud but short (door slam) or broadband (HVAC) sounds get low probability.
+class ofxWhisperEnergyVad : public ofxWhisperVad {
+public:
+    float process(const ofSoundBuffer & buffer) override;
+    void reset() override;
+    string getName() const override { return "energy"; }
+    
+    // Energy above the noise floor to be speech (dB, default:9)
+    void setMinSnr(float db);
+    float getMinSnr() const;
+    
+    // Time for the noise floor to follow rising background noise (sec, default:3)
+    void setNoiseAdaptTime(float sec);
+    float getNoiseAdaptTime() const;
+    
+    // Current noise floor (dB)
+    float getNoiseFloor() const;
+    
+private:
+    float minSnr = 9;
+    float noiseAdaptTime = 3;
+    float noiseFloor = -60;
+    float probability = 0;
+    bool initialized = false;
+    
+    // work buffers (allocated once for the block size)
+    vector<float> mono, re, im, window;
+    
+    static void fft(vector<float> & re, vector<float> & im);
+};
+
+// Neural VAD (Silero model) with whisper.cpp. Needs OFXWHISPER_USE_WHISPER_CPP.
+// e.g. ggml-silero-v5.1.2.bin
+class ofxWhisperNeuralVad : public ofxWhisperVad {
+public:
+    ofxWhisperNeuralVad(string modelPath);
+    ~ofxWhisperNeuralVad();
+    
+    bool setup();
+    float process(const ofSoundBuffer & buffer) override;
+    void reset() override;
+    string getName() const override { return "neural"; }
+    
+private:
+    string modelPath;
+    whisper_vad_context * context = nullptr;
+    
+    // streaming to 16kHz mono. set up for the rate of the captured blocks.
+    ofxWhisperResampler resampler;
+    int inputRate = 0;
+    vector<float> mono, resampled;
+    
+    // 16kHz mono samples waiting for a model window
+    vector<float> pending;
+    
+    // the latest windows. the model state is not kept between calls,
+    // so each call runs over this context and the last probability is used.
+    vector<float> history;
+    size_t numHistory = 0;
+    float probability = 0;
+};
@@ -0,0 +1,2 @@
+// MockServer of the benchmark example
+#include "../../example-ofxWhisper-benchmark/src/MockServer.cpp"
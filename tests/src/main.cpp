@@ -0,0 +1,479 @@
+#include "ofMain.h"
+#include <random>
+#include "ofxWhisper.h"
+#include "ofxWhisperBackend.h"
+#include "ofxWhisperOpenAIBackend.h"
+#include "ofxWhisperBatch.h"
+#include "ofxWhisperQueue.h"
+#include "ofxWhisperRingBuffer.h"
+#include "ofxWhisperResampler.h"
+#include "ofxWhisperDsp.h"
+#include "ofxWhisperJournal.h"
+#include "ofxWhisperCache.h"
+#include "ofxWhisperAudioPool.h"
+#include "../../example-ofxWhisper-benchmark/src/MockServer.h"
+
+//========================================================================
+// Checks without sound device, network or API key. Exit code is the num of failures.
+// ./tests
+
+static int numFailed = 0;
+
+static void check(const string & name, const string & actual, const string & expected) {
+	if (actual == expected) {
+		ofLogNotice("tests") << "ok: " << name;
+	} else {
+		ofLogError("tests") << "FAILED: " << name << ": \"" << actual << "\" (expected \"" << expected << "\")";
+		numFailed++;
+	}
+}
+
+static void checkNear(const string & name, float actual, float expected, float tolerance) {
+	check(name, std::abs(actual - expected) <= tolerance ? ofToString(expected) : ofToString(actual), ofToString(expected));
+}
+
+static void testQueue() {
+	// capacity is rounded up to 4
+	ofxWhisperQueue<int> queue(3);
+	check("queue: capacity", ofToString(queue.getCapacity()), "4");
+	int value = -1;
+	check("queue: empty pop", ofToString(queue.tryPop(value)), "0");
+	
+	// push and pop across the end of the cells many times
+	string order;
+	for (int i = 0; i < 10; i++) {
+		for (int j = 0; j < 3; j++) queue.tryPush(i * 3 + j);
+		for (int j = 0; j < 3; j++) {
+			queue.tryPop(value);
+			if (value != i * 3 + j) order += ofToString(value) + " ";
+		}
+	}
+	check("queue: wraparound order", order, "");
+	
+	for (int i = 0; i < 4; i++) queue.tryPush(std::move(i));
+	check("queue: full push", ofToString(queue.tryPush(4)), "0");
+	check("queue: full size", ofToString(queue.size()), "4");
+	queue.tryPop(value);
+	check("queue: pop after full", ofToString(value), "0");
+	check("queue: push after pop", ofToString(queue.tryPush(4)), "1");
+	
+	// every value is taken once by 4 producers and 4 consumers
+	ofxWhisperQueue<int> mpmc(64);
+	const int numValues = 20000;
+	std::atomic<int> numPopped(0);
+	std::atomic<long long> sum(0);
+	vector<std::thread> threads;
+	for (int t = 0; t < 4; t++) {
+		threads.emplace_back([&, t] {
+			for (int i = t; i < numValues; i += 4) {
+				while (!mpmc.tryPush(std::move(i))) std::this_thread::yield();
+			}
+		});
+		threads.emplace_back([&] {
+			int v;
+			while (numPopped < numValues) {
+				if (mpmc.tryPop(v)) {
+					sum += v;
+					numPopped++;
+				} else {
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+	for (auto & thread : threads) thread.join();
+	check("queue: mpmc sum", ofToString(sum.load()), ofToString((long long)numValues * (numValues - 1) / 2));
+	check("queue: mpmc empty", ofToString(mpmc.empty()), "1");
+}
+
+static void testRingBuffer() {
+	ofxWhisperRingBuffer<int> ring(5);
+	int data[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+	int out[8] = {};
+	ring.write(data, 3);
+	ring.read(out, 2);
+	
+	// written across the end of the buffer
+	check("ring: wrap write", ofToString(ring.write(data + 3, 4)), "4");
+	check("ring: readable", ofToString(ring.getNumReadable()), "5");
+	
+	// the dropped samples are the overflow
+	check("ring: overflow", ofToString(2 - ring.write(data, 2)), "2");
+	check("ring: read", ofToString(ring.read(out, 8)), "5");
+	check("ring: wrap order", ofJoinString({ofToString(out[0]), ofToString(out[1]), ofToString(out[2]), ofToString(out[3]), ofToString(out[4])}, " "), "3 4 5 6 7");
+	check("ring: empty", ofToString(ring.getNumReadable()) + " " + ofToString(ring.getNumWritable()), "0 5");
+	
+	ofxWhisperHistoryBuffer<int> history(3);
+	history.write(data, 2);
+	history.write(data + 2, 3);
+	history.copyTo(out);
+	check("history: latest", ofJoinString({ofToString(out[0]), ofToString(out[1]), ofToString(out[2])}, " "), "3 4 5");
+}
+
+static void testResampler() {
+	// 1 kHz sine at 48 kHz to 16 kHz
+	vector<float> in(48000);
+	for (size_t i = 0; i < in.size(); i++) in[i] = 0.5 * sin(TWO_PI * 1000 * i / 48000.0);
+	vector<float> out;
+	ofxWhisperResampler::resample(in.data(), in.size(), 48000, 16000, out);
+	check("resampler: length", ofToString(out.size()), "16000");
+	float error = 0;
+	for (size_t i = 100; i < out.size() - 100; i++) {
+		error = MAX(error, std::abs(out[i] - 0.5f * (float)sin(TWO_PI * 1000 * i / 16000.0)));
+	}
+	checkNear("resampler: 48k to 16k sine", error, 0, 0.01);
+	
+	ofxWhisperResampler::resample(in.data(), 44100, 44100, 16000, out);
+	check("resampler: 44.1k length", ofToString(out.size()), "16000");
+	
+	// 16 kHz is passed through
+	ofxWhisperResampler::resample(in.data(), 1000, 16000, 16000, out);
+	check("resampler: passthrough", ofToString(out.size() == 1000 && std::equal(out.begin(), out.end(), in.begin())), "1");
+	
+	// stereo is averaged
+	float stereo[8] = {1, 0, 0.5, 0.5, 0, 1, -1, 1};
+	ofxWhisperResampler::toMono(stereo, 4, 2, 16000, 16000, out);
+	check("resampler: downmix", ofJoinString({ofToString(out[0]), ofToString(out[1]), ofToString(out[2]), ofToString(out[3])}, " "), "0.5 0.5 0.5 0");
+}
+
+static void testDsp() {
+	// lengths not divisible by the vector width leave tails for the scalar loop
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> dist(-1.2, 1.2);
+	string mismatches;
+	for (size_t numChannels : {1, 2, 3, 6}) {
+		for (size_t numFrames : {0, 1, 3, 7, 8, 15, 17, 33, 256, 257}) {
+			size_t n = numFrames * numChannels;
+			vector<float> data(n);
+			for (auto & v : data) v = dist(random) + 0.1;
+			
+			float peak[2], rms[2];
+			vector<float> mono[2], dc[2];
+			vector<int16_t> pcm[2];
+			for (int simd = 0; simd < 2; simd++) {
+				ofxWhisperDsp::setSimdEnabled(simd);
+				peak[simd] = ofxWhisperDsp::peak(data.data(), n);
+				rms[simd] = ofxWhisperDsp::rms(data.data(), n);
+				mono[simd].resize(numFrames);
+				ofxWhisperDsp::downmix(data.data(), numFrames, numChannels, mono[simd].data());
+				pcm[simd].resize(n);
+				ofxWhisperDsp::toInt16(data.data(), n, pcm[simd].data());
+				dc[simd] = data;
+				vector<float> offset(numChannels, 0.05);
+				ofxWhisperDsp::removeDc(dc[simd].data(), numFrames, numChannels, offset.data(), 0.5);
+				dc[simd].insert(dc[simd].end(), offset.begin(), offset.end());
+			}
+			auto near = [](const vector<float> & a, const vector<float> & b) {
+				for (size_t i = 0; i < a.size(); i++) {
+					if (std::abs(a[i] - b[i]) > 1e-5) return false;
+				}
+				return true;
+			};
+			string name = ofToString(numChannels) + "x" + ofToString(numFrames);
+			if (peak[0] != peak[1]) mismatches += " peak " + name;
+			if (std::abs(rms[0] - rms[1]) > 1e-5) mismatches += " rms " + name;
+			if (!near(mono[0], mono[1])) mismatches += " downmix " + name;
+			if (pcm[0] != pcm[1]) mismatches += " toInt16 " + name;
+			if (!near(dc[0], dc[1])) mismatches += " removeDc " + name;
+		}
+	}
+	ofxWhisperDsp::setSimdEnabled(true);
+	check("dsp: " + ofxWhisperDsp::getImplementation() + " equals scalar", mismatches, "");
+}
+
+static void testJournal() {
+	string directory = ofFilePath::join(ofFilePath::getCurrentWorkingDirectory(), "test_journal_records");
+	string path = ofFilePath::join(directory, "journal.bin");
+	ofDirectory::removeDirectory(directory, true);
+	
+	uint64_t first, second, third;
+	{
+		ofxWhisperJournal journal;
+		journal.setup(directory);
+		first = journal.add({{"n", 1}}, string(1000, 'a'));
+		second = journal.add({{"n", 2}}, string(1000, 'b'));
+		third = journal.add({{"n", 3}}, string(1000, 'c'));
+		journal.markDone(first);
+		check("journal: pending", ofToString(journal.getNumPending()), "2");
+	}
+	{
+		// reopen
+		ofxWhisperJournal journal;
+		journal.setup(directory);
+		auto ids = journal.getPendingIds();
+		check("journal: reopen", ofToString(ids.size() == 2 && ids[0] == second && ids[1] == third), "1");
+		ofJson meta;
+		string data;
+		check("journal: read", ofToString(journal.read(third, meta, data) && meta.value("n", 0) == 3 && data == string(1000, 'c')), "1");
+	}
+	{
+		// a record cut by a crash is dropped
+		string bytes = ofBufferFromFile(path, true).getText();
+		std::ofstream(path, std::ios::binary | std::ios::trunc) << bytes.substr(0, bytes.size() - 10);
+		ofxWhisperJournal journal;
+		journal.setup(directory);
+		auto ids = journal.getPendingIds();
+		check("journal: torn record", ofToString(ids.size() == 1 && ids[0] == second), "1");
+		uint64_t id = journal.add({{"n", 4}}, "d");
+		check("journal: add after torn record", ofToString(id != 0 && id != second), "1");
+		
+		// done records are removed from the file when they are more than the pending ones
+		uint64_t recordSize = ofFile(path).getSize();
+		journal.markDone(second);
+		check("journal: compact", ofToString(ofFile(path).getSize() < recordSize), "1");
+		ofJson meta;
+		string data;
+		check("journal: read after compact", ofToString(journal.read(id, meta, data) && data == "d"), "1");
+	}
+	{
+		ofxWhisperJournal journal;
+		journal.setup(directory);
+		auto ids = journal.getPendingIds();
+		check("journal: reopen after compact", ofToString(ids.size()), "1");
+	}
+	ofDirectory::removeDirectory(directory, true);
+}
+
+static void testCache() {
+	// room for 2 entries in memory
+	ofxWhisperCache cache;
+	cache.setup("", 2 * (100 + 64));
+	ofSoundBuffer pcm[3];
+	ofxWhisperCache::Key keys[3];
+	for (int i = 0; i < 3; i++) {
+		pcm[i].allocate(160, 1);
+		pcm[i].setSampleRate(16000);
+		pcm[i][0] = i;
+		keys[i] = ofxWhisperCache::makeKey(pcm[i], "", "en", "whisper-1");
+	}
+	check("cache: prompt is in the key", ofToString(ofxWhisperCache::makeKey(pcm[0], "p", "en", "whisper-1") == keys[0]), "0");
+	
+	string text;
+	check("cache: miss", ofToString(cache.get(keys[0], text)), "0");
+	cache.put(keys[0], string(100, 'a'));
+	cache.put(keys[1], string(100, 'b'));
+	check("cache: hit", ofToString(cache.get(keys[0], text) && text == string(100, 'a')), "1");
+	
+	// the least recently used one is evicted
+	cache.put(keys[2], string(100, 'c'));
+	check("cache: evicted", ofToString(cache.get(keys[1], text)), "0");
+	check("cache: kept", ofToString(cache.get(keys[0], text) && cache.get(keys[2], text)), "1");
+	check("cache: counts", ofToString(cache.getNumHits()) + " " + ofToString(cache.getNumMisses()) + " " + ofToString(cache.getNumMemoryEntries()), "3 2 2");
+}
+
+static void testParseDuration() {
+	checkNear("parseDuration: 6m0s", ofxWhisperOpenAIBackend::parseDuration("6m0s"), 360, 1e-4);
+	checkNear("parseDuration: 20ms", ofxWhisperOpenAIBackend::parseDuration("20ms"), 0.02, 1e-4);
+	checkNear("parseDuration: 1h2m3.5s", ofxWhisperOpenAIBackend::parseDuration("1h2m3.5s"), 3723.5, 1e-3);
+	checkNear("parseDuration: 1s", ofxWhisperOpenAIBackend::parseDuration("1s"), 1, 1e-4);
+}
+
+static void testAudioPool() {
+	ofxWhisperAudioPool pool;
+	pool.allocate(2, 256, 1, 16000);
+	auto a = pool.acquire();
+	auto b = pool.acquire();
+	check("pool: all in use", ofToString((bool)pool.acquire()), "0");
+	
+	// back to the pool with the last reference
+	auto copy = a;
+	a.reset();
+	check("pool: still referenced", ofToString((bool)pool.acquire()), "0");
+	copy.reset();
+	auto c = pool.acquire();
+	check("pool: returned", ofToString((bool)c), "1");
+	
+	// blocks outlive a closed pool while they are referenced
+	ofxWhisperAudioBlockRef kept;
+	{
+		ofxWhisperAudioPool closed;
+		closed.allocate(1, 256, 1, 16000);
+		kept = closed.acquire();
+	}
+	check("pool: closed while referenced", ofToString(kept->getNumFrames()), "256");
+	kept.reset();
+}
+
+static void testStitchTranscripts() {
+	check("overlapping words", ofxWhisper::stitchTranscripts({"we meet at the end of", "the end of the day"}), "we meet at the end of the day");
+	check("one-word trailing chunk", ofxWhisper::stitchTranscripts({"see you at the end", "Thanks."}), "see you at the end Thanks.");
+	check("one-word leading chunk", ofxWhisper::stitchTranscripts({"Hello.", "How are you?"}), "Hello. How are you?");
+	check("repeated one word", ofxWhisper::stitchTranscripts({"at the end", "end"}), "at the end");
+	check("unspaced overlap", ofxWhisper::stitchTranscripts({"今日はいい天気ですね", "天気ですね明日も晴れ"}), "今日はいい天気ですね明日も晴れ");
+	check("unspaced no overlap", ofxWhisper::stitchTranscripts({"こんにちは", "さようなら"}), "こんにちはさようなら");
+	check("empty chunk", ofxWhisper::stitchTranscripts({"one two", "", "three"}), "one two three");
+	check("unspaced word in a spaced chunk", ofxWhisper::stitchTranscripts({"we went to", "Tokyo 東京 by train"}), "we went to Tokyo 東京 by train");
+	check("spaced word at an unspaced join", ofxWhisper::stitchTranscripts({"新しいiPhone", "を買いました"}), "新しいiPhoneを買いました");
+	check("spaced chunks around an unspaced word", ofxWhisper::stitchTranscripts({"東京 is big", "and busy"}), "東京 is big and busy");
+}
+
+// Backend returning the prompt as the text, or errorCode (NetworkError for the prompt "offline")
+class EchoBackend : public ofxWhisperBackend {
+public:
+	Result transcribe(const Request & request) override {
+		ofSleepMillis(50);
+		Result result;
+		result.errorCode = request.prompt == "offline" ? ofxWhisper::NetworkError : errorCode.load();
+		result.text = request.prompt;
+		result.retryAfter = 10;
+		numRequests++;
+		return result;
+	}
+	string getName() const override { return "echo"; }
+	
+	std::atomic<ofxWhisper::ErrorCode> errorCode{ofxWhisper::Success};
+	std::atomic<int> numRequests{0};
+};
+
+static void testListenerCallingBack() {
+	ofxWhisper whisper;
+	whisper.setup(make_shared<EchoBackend>());
+	ofSoundBuffer buffer;
+	buffer.allocate(1600, 1);
+	buffer.setSampleRate(16000);
+	
+	// cancel() from a transcriptEvents listener must not deadlock. One worker, so the second
+	// item is still queued when the first is notified.
+	std::atomic<bool> cancelled(false);
+	std::atomic<uint64_t> secondId(0);
+	auto listener = whisper.transcriptEvents.newListener([&](ofxWhisper::TranscriptResult & r) {
+		if (r.id != secondId) cancelled = whisper.cancel(secondId);
+	});
+	auto first = whisper.transcript(buffer);
+	auto second = whisper.transcript(buffer);
+	secondId = second.getId();
+	check("listener calling cancel(): first", ofToString(first.wait(5)), "1");
+	check("listener calling cancel(): second", ofToString(second.wait(5)), "1");
+	check("listener calling cancel(): cancelled", ofToString(cancelled.load()), "1");
+	if (second.isReady()) {
+		check("listener calling cancel(): result", ofToString(second.get().errorCode), ofToString(ofxWhisper::Cancelled));
+	}
+}
+
+static void testCompletionThread() {
+	ofxWhisper whisper;
+	auto backend = make_shared<EchoBackend>();
+	whisper.setup(backend);
+	ofSoundBuffer buffer;
+	buffer.allocate(1600, 1);
+	buffer.setSampleRate(16000);
+	
+	// the WorkerThread callback of an item cancelled here (waiting for retry) is not run by cancel()
+	backend->errorCode = ofxWhisper::ServerError;
+	std::atomic<bool> onThisThread(true);
+	auto mainThread = std::this_thread::get_id();
+	auto handle = whisper.transcript(buffer, [&](const ofxWhisper::TranscriptResult &) {
+		onThisThread = std::this_thread::get_id() == mainThread;
+	});
+	for (int i = 0; i < 500 && backend->numRequests == 0; i++) ofSleepMillis(10);
+	ofSleepMillis(50);
+	check("completion thread: cancelled", ofToString(whisper.cancel(handle.getId())), "1");
+	for (int i = 0; i < 100 && onThisThread; i++) ofSleepMillis(10);
+	check("completion thread: not the caller of cancel()", ofToString(onThisThread.load()), "0");
+}
+
+static void testJournalReplayOrder() {
+	string directory = ofFilePath::join(ofFilePath::getCurrentWorkingDirectory(), "test_journal");
+	ofDirectory::removeDirectory(directory, true);
+	{
+		ofxWhisper whisper;
+		whisper.setup(make_shared<EchoBackend>());
+		whisper.setMaxRetries(0);
+		whisper.setJournal(directory, 10);
+		ofSoundBuffer buffer;
+		buffer.allocate(1600, 1);
+		buffer.setSampleRate(16000);
+		
+		// a parked item does not hold back the next transcripts
+		whisper.setPrompt("offline");
+		auto parked = whisper.transcript(buffer);
+		whisper.setPrompt("online");
+		auto live = whisper.transcript(buffer);
+		check("journal replay order: parked completion", ofToString(parked.wait(5) ? parked.get().errorCode : -1), ofToString(ofxWhisper::NetworkError));
+		check("journal replay order: live", ofToString(live.wait(5) ? live.get().text : ""), "online");
+	}
+	ofDirectory::removeDirectory(directory, true);
+}
+
+static void testReconnectIdleConnection() {
+	// the mock server closes idle connections before the backend does
+	MockServer server;
+	MockServer::Settings settings;
+	settings.port = 8091;
+	settings.latency = 0;
+	settings.latencyPerAudioSec = 0;
+	settings.jitter = 0;
+	settings.keepAliveTimeout = 0.2;
+	if (!server.start(settings)) {
+		check("reconnect: mock server", "not started", "started");
+		return;
+	}
+	ofxWhisperOpenAIBackend backend("test");
+	backend.setEndpoint(server.getEndpoint());
+	backend.setup();
+	ofxWhisperBackend::Request request;
+	request.buffer.allocate(1600, 1);
+	request.buffer.setSampleRate(16000);
+	
+	auto first = backend.transcribe(request);
+	ofSleepMillis(500);
+	auto second = backend.transcribe(request);
+	check("reconnect: first", ofToString(first.errorCode), ofToString(ofxWhisper::Success));
+	check("reconnect: second", ofToString(second.errorCode), ofToString(ofxWhisper::Success));
+	check("reconnect: connections", ofToString(backend.getNumConnections()), "2");
+	check("reconnect: requests", ofToString(server.getResponseCounts()[200]), "2");
+}
+
+static void testBatchSkipDone() {
+	// a file done with a relative path is skipped when it is given with an absolute one
+	string jsonlPath = "test_batch.jsonl";
+	{
+		std::ofstream jsonl(jsonlPath, std::ios::trunc);
+		jsonl << "{\"file\":\"a.wav\",\"state\":\"done\"}" << std::endl;
+	}
+	ofxWhisperBatchJob job({ofFilePath::getAbsolutePath("a.wav"), "b.wav"}, 8, jsonlPath);
+	check("batch skip done: finished", ofToString(job.getNumFinished()), "1");
+	check("batch skip done: state", ofToString(job.getItem(0).state), ofToString(ofxWhisperBatchJob::Skipped));
+	ofFile::removeFile(jsonlPath);
+}
+
+static void testBatchSrtDirectories() {
+	// files of the same name in different directories get their own SRT file
+	string directory = ofFilePath::join(ofFilePath::getCurrentWorkingDirectory(), "test_batch");
+	ofDirectory::removeDirectory(directory, true);
+	vector<string> files;
+	for (auto sub : {"x", "y"}) {
+		ofDirectory::createDirectory(ofFilePath::join(directory, sub), false, true);
+		files.push_back(ofFilePath::join(ofFilePath::join(directory, sub), "a.wav"));
+		std::ofstream(files.back()) << "RIFF";
+	}
+	{
+		ofxWhisper whisper;
+		whisper.setup(make_shared<EchoBackend>());
+		auto job = whisper.transcriptBatch(files, 8, "", ofFilePath::join(directory, "srt"));
+		check("batch srt: finished", ofToString(job->wait(5)), "1");
+	}
+	check("batch srt: x", ofToString(ofFile::doesFileExist(ofFilePath::join(directory, "srt/x/a.srt"))), "1");
+	check("batch srt: y", ofToString(ofFile::doesFileExist(ofFilePath::join(directory, "srt/y/a.srt"))), "1");
+	ofDirectory::removeDirectory(directory, true);
+}
+
+int main(){
+	testQueue();
+	testRingBuffer();
+	testResampler();
+	testDsp();
+	testJournal();
+	testCache();
+	testParseDuration();
+	testAudioPool();
+	testStitchTranscripts();
+	testListenerCallingBack();
+	testCompletionThread();
+	testJournalReplayOrder();
+	testReconnectIdleConnection();
+	testBatchSkipDone();
+	testBatchSrtDirectories();
+	ofLogNotice("tests") << (numFailed == 0 ? "all passed" : ofToString(numFailed) + " failed");
+	return numFailed;
+}